@@ -1,8 +1,10 @@
 /**
  * @file		BitStream.h
- * @brief		A data stream that operates on bits.
- * 				It is basically a "bit-oriented view" of an underlying byte array,
- * 				so any manipulation on the stream will affect that array.
+ * @brief		Bit-oriented readers and writers over byte arrays, bits being
+ * 				taken most significant first, as NeXaS does.
+ * 				They are plain structs with inline operations, so they can live
+ * 				on the stack, and the underlying array is read or written
+ * 				through a 64-bit bit buffer.
  * @copyright	Covered by 2-clause BSD, please refer to license.txt.
  * @author		CloudiDust
  * @date		2010.02
@@ -11,21 +13,129 @@
 #ifndef BIT_STREAM_H_INCLUDED
 #define BIT_STREAM_H_INCLUDED
 
+#include <string.h>
+
 #include "CommonDef.h"
 
-struct BitStream;
-typedef struct BitStream BitStream;
+/**
+ * The reader keeps the next unread bits at the top of a 64-bit word.
+ * brRefill() tops it up to at least 57 bits while there is data left, and
+ * is the only place where the end of the data is checked. So peek and
+ * consume no more bits than brAvailable() says after a refill. Up to 57
+ * bits can be taken after one refill, but only 32 in one peek.
+ */
+struct BitReader {
+	const byte* data;
+	u32 length;
+	u32 next;
+	u64 bits;
+	u32 count;
+};
+typedef struct BitReader BitReader;
+
+static inline void brInit(BitReader* reader, const byte* data, u32 length) {
+	reader->data = data;
+	reader->length = length;
+	reader->next = 0;
+	reader->bits = 0;
+	reader->count = 0;
+}
+
+static inline void brRefill(BitReader* reader) {
+	if (reader->count > 56) return;
+	if (reader->length - reader->next >= 8) {
+		u64 word;
+		memcpy(&word, reader->data + reader->next, 8);
+		reader->bits |= __builtin_bswap64(word) >> reader->count;
+		reader->next += (63 - reader->count) >> 3;
+		reader->count |= 56;
+		return;
+	}
+	while (reader->count <= 56 && reader->next < reader->length) {
+		reader->bits |= (u64)reader->data[reader->next++] << (56 - reader->count);
+		reader->count += 8;
+	}
+}
+
+static inline u32 brAvailable(const BitReader* reader) {
+	return reader->count;
+}
+
+/// 1 to 32 bits.
+static inline u32 brPeek(const BitReader* reader, u32 count) {
+	return reader->bits >> (64 - count);
+}
 
-BitStream* newBitStream(byte* data, u32 length);
-void deleteBitStream(BitStream* bs);
+static inline void brConsume(BitReader* reader, u32 count) {
+	reader->bits <<= count;
+	reader->count -= count;
+}
 
-bool bsNextBit(BitStream* bs, byte* result);
-bool bsNextByte(BitStream* bs, byte* result);
+/// Refills, checks and takes 1 to 32 bits, for when speed does not matter.
+static inline bool brRead(BitReader* reader, u32 count, u32* result) {
+	brRefill(reader);
+	if (reader->count < count) return false;
+	*result = brPeek(reader, count);
+	brConsume(reader, count);
+	return true;
+}
+
+/**
+ * The writer gathers bits at the top of a 64-bit word, and stores them
+ * 32 at a time. The end of the array is checked only when storing.
+ * Call bwFlush() at the end to store the last bits, the last byte padded
+ * with zeroes.
+ */
+struct BitWriter {
+	byte* data;
+	u32 length;
+	u32 next;
+	u64 bits;
+	u32 count;
+};
+typedef struct BitWriter BitWriter;
+
+static inline void bwInit(BitWriter* writer, byte* data, u32 length) {
+	writer->data = data;
+	writer->length = length;
+	writer->next = 0;
+	writer->bits = 0;
+	writer->count = 0;
+}
+
+/**
+ * Puts the low 0 to 32 bits of value, the bits above them are ignored.
+ * Returns false if the array is full, and the writer is of no more use then.
+ */
+static inline bool bwPut(BitWriter* writer, u32 value, u32 count) {
+	if (count == 0) return true;
+	/// A stray high bit would land on the bits already written.
+	writer->bits |= ((u64)value & ((1ull << count) - 1)) << (64 - writer->count - count);
+	writer->count += count;
+	if (writer->count >= 32) {
+		if (writer->length - writer->next < 4) return false;
+		u32 word = __builtin_bswap32((u32)(writer->bits >> 32));
+		memcpy(writer->data + writer->next, &word, 4);
+		writer->next += 4;
+		writer->bits <<= 32;
+		writer->count -= 32;
+	}
+	return true;
+}
 
-bool bsSetNextBit(BitStream* bs, byte data);
-bool bsSetNextByte(BitStream* bs, byte data);
+static inline bool bwFlush(BitWriter* writer) {
+	while (writer->count > 0) {
+		if (writer->next == writer->length) return false;
+		writer->data[writer->next++] = writer->bits >> 56;
+		writer->bits <<= 8;
+		writer->count = writer->count > 8 ? writer->count - 8 : 0;
+	}
+	return true;
+}
 
-u32 bsGetCurrentByteIndex(const BitStream* bs);
-u32 bsGetCurrentBitIndex(const BitStream* bs);
+/// The bytes stored so far, not counting the bits still gathered.
+static inline u32 bwBytesWritten(const BitWriter* writer) {
+	return writer->next;
+}
 
 #endif
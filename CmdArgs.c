@@ -12,25 +12,53 @@
 #include "Logger.h"
 #include "StringUtils.h"
 #include "FileSystem.h"
+#include "ThreadPool.h"
 #include "CmdArgs.h"
 
 struct CmdArgs {
 	CmdType cmdType;
 	LogLevel logLevel;
+	u32 threadCount;
+	bool useIndexCache;
+	bool compress;
+	bool huffman;
+	u32 lzssLevel;
 	wchar_t* sourcePath;
 	wchar_t* targetPath;
+	/// Only 'merge' and 'build-translation' have a third path, the package to write.
+	wchar_t* outputPath;
+	wchar_t** entryNames;
+	u32 entryNameCount;
 };
 
 /**
  * The parser is a simple FSM, that accepts:
- * (quietly|verbosely)? (pack|zip|unpack|help|about) (source_path) (target_path)?
+ * (quietly|verbosely)? (options)* (pack|zip|unpack|help|about) (source_path) (target_path)?
+ * where unpack-scripts takes a directory or a package as its source,
+ * or, for operations on single entries:
+ * (quietly|verbosely)? (options)* (extract|cat) (package_path) (entry_name)+
+ * or, for updating a package in place:
+ * (quietly|verbosely)? (options)* patch (package_path) (overlay_dir)
+ * (quietly|verbosely)? (options)* compact (package_path)
+ * (quietly|verbosely)? (options)* merge (package_path) (overlay_dir) (output_path)
+ * (quietly|verbosely)? (options)* build-translation (scripts_dir) (package_path) (output_path)
+ * where an option is one of:
+ * -j thread_count
+ * -c (use the index cache)
+ * -z (compress the entries when packing)
+ * -zh (huffman-encode the entries when packing)
+ * -l lzss_level
  */
 
 enum StateCode {
 	APS_WAITING_CMD_OR_LOG_LEVEL,
 	APS_WAITING_CMD,
+	APS_WAITING_THREAD_COUNT,
+	APS_WAITING_LZSS_LEVEL,
 	APS_WAITING_SOURCE,
 	APS_WAITING_TARGET,
+	APS_WAITING_OUTPUT,
+	APS_WAITING_ENTRY_NAME,
 	APS_FINISHED,
 	APS_ERROR
 };
@@ -46,6 +74,17 @@ void deleteCmdArgs(CmdArgs* args) {
 		free(args->targetPath);
 		args->targetPath = NULL;
 	}
+	if (args->outputPath != NULL) {
+		free(args->outputPath);
+		args->outputPath = NULL;
+	}
+	if (args->entryNames != NULL) {
+		for (u32 i = 0; i < args->entryNameCount; ++i) {
+			free(args->entryNames[i]);
+		}
+		free(args->entryNames);
+		args->entryNames = NULL;
+	}
 	free(args);
 	args = NULL;
 }
@@ -67,10 +106,46 @@ static StateCode readCmd(CmdArgs* args, const char* str) {
 			args->cmdType = CMD_PACK_SCRIPT;
 			return APS_WAITING_SOURCE;
 	}
+	if (strcmp(str, "pack-scripts") == 0) {
+		args->cmdType = CMD_PACK_SCRIPTS;
+		return APS_WAITING_SOURCE;
+	}
 	if (strcmp(str, "unpack-script") == 0) {
 		args->cmdType = CMD_UNPACK_SCRIPT;
 		return APS_WAITING_SOURCE;
 	}
+	if (strcmp(str, "unpack-scripts") == 0) {
+		args->cmdType = CMD_UNPACK_SCRIPTS;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "extract") == 0) {
+		args->cmdType = CMD_EXTRACT;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "cat") == 0) {
+		args->cmdType = CMD_CAT;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "list") == 0) {
+		args->cmdType = CMD_LIST;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "patch") == 0) {
+		args->cmdType = CMD_PATCH;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "merge") == 0) {
+		args->cmdType = CMD_MERGE;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "build-translation") == 0) {
+		args->cmdType = CMD_BUILD_TRANSLATION;
+		return APS_WAITING_SOURCE;
+	}
+	if (strcmp(str, "compact") == 0) {
+		args->cmdType = CMD_COMPACT;
+		return APS_WAITING_SOURCE;
+	}
 	if (strcmp(str, "help") == 0) {
 		args->cmdType = CMD_HELP;
 		return APS_FINISHED;
@@ -82,7 +157,65 @@ static StateCode readCmd(CmdArgs* args, const char* str) {
 	return APS_ERROR;
 }
 
+static StateCode readCmdOrOption(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		return APS_ERROR;
+
+	if (strcmp(str, "-j") == 0)
+		return APS_WAITING_THREAD_COUNT;
+
+	if (strcmp(str, "-l") == 0)
+		return APS_WAITING_LZSS_LEVEL;
+
+	if (strcmp(str, "-c") == 0) {
+		args->useIndexCache = true;
+		return APS_WAITING_CMD;
+	}
+
+	if (strcmp(str, "-z") == 0) {
+		args->compress = true;
+		return APS_WAITING_CMD;
+	}
+
+	if (strcmp(str, "-zh") == 0) {
+		args->compress = true;
+		args->huffman = true;
+		return APS_WAITING_CMD;
+	}
+
+	return readCmd(args, str);
+}
+
+static StateCode readThreadCount(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		return APS_ERROR;
+
+	char* end = NULL;
+	long count = strtol(str, &end, 10);
+	if (*end != '\0' || count < 1 || count > 256)
+		return APS_ERROR;
+
+	args->threadCount = count;
+	return APS_WAITING_CMD;
+}
+
+static StateCode readLzssLevel(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		return APS_ERROR;
+
+	char* end = NULL;
+	long level = strtol(str, &end, 10);
+	if (*end != '\0' || level < 0 || level > 3)
+		return APS_ERROR;
+
+	args->lzssLevel = level;
+	return APS_WAITING_CMD;
+}
+
 static StateCode readCmdOrLogLevel(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		return APS_ERROR;
+
 	if (strcmp(str, "verbosely") == 0) {
 		args->logLevel = LOG_VERBOSE;
 		return APS_WAITING_CMD;
@@ -92,24 +225,56 @@ static StateCode readCmdOrLogLevel(CmdArgs* args, const char* str) {
 		return APS_WAITING_CMD;
 	}
 
-	return readCmd(args, str);
+	return readCmdOrOption(args, str);
 }
 
 static StateCode readSourcePath(CmdArgs* args, const char* str) {
 	if (str == NULL)
 		return APS_ERROR;
 
-	args->sourcePath = toWCString(str, L".ACP");
+	args->sourcePath = toWCString(str, CODE_PAGE_ANSI);
+	if (args->sourcePath == NULL)
+		return APS_ERROR;
+	if (args->cmdType == CMD_EXTRACT || args->cmdType == CMD_CAT)
+		return APS_WAITING_ENTRY_NAME;
+	if (args->cmdType == CMD_LIST || args->cmdType == CMD_COMPACT)
+		return APS_FINISHED;
 	return APS_WAITING_TARGET;
 }
 
 static StateCode readTargetPath(CmdArgs* args, const char* str) {
 	if (str == NULL)
-		/// We will use the default target path.
-		return APS_FINISHED;
+		/// We will use the default target path, except that there is no default overlay.
+		return (args->cmdType == CMD_PATCH || args->cmdType == CMD_MERGE
+				|| args->cmdType == CMD_BUILD_TRANSLATION) ? APS_ERROR : APS_FINISHED;
 
-	args->targetPath = toWCString(str, L".ACP");
-	return APS_FINISHED;
+	args->targetPath = toWCString(str, CODE_PAGE_ANSI);
+	if (args->targetPath == NULL)
+		return APS_ERROR;
+	return (args->cmdType == CMD_MERGE || args->cmdType == CMD_BUILD_TRANSLATION)
+			? APS_WAITING_OUTPUT : APS_FINISHED;
+}
+
+static StateCode readOutputPath(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		return APS_ERROR;
+
+	args->outputPath = toWCString(str, CODE_PAGE_ANSI);
+	return args->outputPath ? APS_FINISHED : APS_ERROR;
+}
+
+static StateCode readEntryName(CmdArgs* args, const char* str) {
+	if (str == NULL)
+		/// At least one name is needed.
+		return args->entryNameCount > 0 ? APS_FINISHED : APS_ERROR;
+
+	args->entryNames = realloc(args->entryNames, sizeof(wchar_t*) * (args->entryNameCount + 1));
+	args->entryNames[args->entryNameCount++] = toWCString(str, CODE_PAGE_ANSI);
+	if (args->entryNames[args->entryNameCount - 1] == NULL)
+		return APS_ERROR;
+
+	/// 'cat' writes exactly one entry to stdout.
+	return args->cmdType == CMD_CAT ? APS_FINISHED : APS_WAITING_ENTRY_NAME;
 }
 
 static void useAbsolutePath(CmdArgs* args) {
@@ -122,12 +287,22 @@ static void useAbsolutePath(CmdArgs* args) {
 		free(args->targetPath);
 		args->targetPath = aTargetPath;
 	}
+
+	if (args->outputPath != NULL) {
+		wchar_t* aOutputPath = fsAbsolutePath(args->outputPath);
+		free(args->outputPath);
+		args->outputPath = aOutputPath;
+	}
 }
 
 static void fillWithDefaultArgs(CmdArgs* args) {
 	if (args->logLevel == LOG_NOT_SPECIFIED)
 		args->logLevel = LOG_NORMAL;
 
+	/// By default, use one worker per processor.
+	if (args->threadCount == 0)
+		args->threadCount = poolDefaultThreadCount();
+
 	if (args->targetPath == NULL) {
 		if (args->cmdType == CMD_PACK || args->cmdType == CMD_PACK_BFE) {
 			/**
@@ -140,7 +315,19 @@ static void fillWithDefaultArgs(CmdArgs* args) {
 			 * When packing script, target should be a 'bin' file.
 			 */
 			args->targetPath = wcsAppend(args->sourcePath, L".bin");
-		} else if (args->cmdType == CMD_UNPACK || args->cmdType == CMD_UNPACK_SCRIPT) {
+		} else if (args->cmdType == CMD_PACK_SCRIPTS) {
+			/**
+			 * The .bin files go right beside the script directories,
+			 * as with pack-script.
+			 */
+			args->targetPath = cloneWCString(args->sourcePath);
+		} else if (args->cmdType == CMD_EXTRACT) {
+			/**
+			 * Single entries are extracted into the current directory.
+			 */
+			args->targetPath = fsAbsolutePath(L".");
+		} else if (args->cmdType == CMD_UNPACK || args->cmdType == CMD_UNPACK_SCRIPT
+				|| args->cmdType == CMD_UNPACK_SCRIPTS) {
 			/**
 			 * To obtain the default path, remove the extension.
 			 * Be aware that the last dot may not be a indicator of extension,
@@ -169,7 +356,7 @@ CmdArgs* parseCmdLine(int argc, char** argv) {
 	CmdArgs* args = malloc(sizeof(CmdArgs));
 	memset(args, 0, sizeof(CmdArgs));
 
-	u8 index = 1;
+	u32 index = 1;
 	StateCode state = APS_WAITING_CMD_OR_LOG_LEVEL;
 
 	while (state != APS_FINISHED && state != APS_ERROR) {
@@ -181,7 +368,13 @@ CmdArgs* parseCmdLine(int argc, char** argv) {
 			state = readCmdOrLogLevel(args, currStr);
 			break;
 		case APS_WAITING_CMD:
-			state = readCmd(args, currStr);
+			state = readCmdOrOption(args, currStr);
+			break;
+		case APS_WAITING_THREAD_COUNT:
+			state = readThreadCount(args, currStr);
+			break;
+		case APS_WAITING_LZSS_LEVEL:
+			state = readLzssLevel(args, currStr);
 			break;
 		case APS_WAITING_SOURCE:
 			state = readSourcePath(args, currStr);
@@ -189,6 +382,12 @@ CmdArgs* parseCmdLine(int argc, char** argv) {
 		case APS_WAITING_TARGET:
 			state = readTargetPath(args, currStr);
 			break;
+		case APS_WAITING_OUTPUT:
+			state = readOutputPath(args, currStr);
+			break;
+		case APS_WAITING_ENTRY_NAME:
+			state = readEntryName(args, currStr);
+			break;
 		default:
 			break;
 		}
@@ -216,9 +415,41 @@ const wchar_t* argSourcePath(const CmdArgs* args) {
 	return args->sourcePath;
 }
 
+const wchar_t* argOutputPath(const CmdArgs* args) {
+	return args->outputPath;
+}
+
 const wchar_t* argTargetPath(const CmdArgs* args) {
 	return args->targetPath;
 }
 const LogLevel argLogLevel(const CmdArgs* args) {
 	return args->logLevel;
 }
+
+u32 argThreadCount(const CmdArgs* args) {
+	return args->threadCount;
+}
+
+bool argUseIndexCache(const CmdArgs* args) {
+	return args->useIndexCache;
+}
+
+bool argCompress(const CmdArgs* args) {
+	return args->compress;
+}
+
+bool argHuffman(const CmdArgs* args) {
+	return args->huffman;
+}
+
+u32 argLzssLevel(const CmdArgs* args) {
+	return args->lzssLevel;
+}
+
+const wchar_t* const* argEntryNames(const CmdArgs* args) {
+	return (const wchar_t* const*)args->entryNames;
+}
+
+u32 argEntryNameCount(const CmdArgs* args) {
+	return args->entryNameCount;
+}
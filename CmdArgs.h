@@ -19,7 +19,16 @@ enum CmdType {
 	CMD_PACK_BFE,
 	CMD_UNPACK,
 	CMD_PACK_SCRIPT,
+	CMD_PACK_SCRIPTS,
 	CMD_UNPACK_SCRIPT,
+	CMD_UNPACK_SCRIPTS,
+	CMD_EXTRACT,
+	CMD_CAT,
+	CMD_LIST,
+	CMD_PATCH,
+	CMD_COMPACT,
+	CMD_MERGE,
+	CMD_BUILD_TRANSLATION,
 	CMD_HELP,
 	CMD_ABOUT
 };
@@ -31,6 +40,14 @@ void deleteCmdArgs(CmdArgs* args);
 CmdType argCmdType(const CmdArgs* args);
 const wchar_t* argSourcePath(const CmdArgs* args);
 const wchar_t* argTargetPath(const CmdArgs* args);
+const wchar_t* argOutputPath(const CmdArgs* args);
 const LogLevel argLogLevel(const CmdArgs* args);
+u32 argThreadCount(const CmdArgs* args);
+bool argUseIndexCache(const CmdArgs* args);
+bool argCompress(const CmdArgs* args);
+bool argHuffman(const CmdArgs* args);
+u32 argLzssLevel(const CmdArgs* args);
+const wchar_t* const* argEntryNames(const CmdArgs* args);
+u32 argEntryNameCount(const CmdArgs* args);
 
 #endif
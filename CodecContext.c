@@ -0,0 +1,93 @@
+/**
+ * @file		CodecContext.c
+ * @brief		The decoders and scratch buffers of one worker, kept and reused
+ * 				for every entry the worker decodes.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CodecContext.h"
+
+struct CodecContext {
+	z_stream inflater;
+	bool inflaterReady;
+	LzssDecoder* lzss;
+	HuffmanDecoder* huffman;
+	byte* output;
+	u32 outputSize;
+	byte* input;
+	u32 inputSize;
+};
+
+CodecContext* newCodecContext(void) {
+	CodecContext* codec = malloc(sizeof(CodecContext));
+	memset(codec, 0, sizeof(CodecContext));
+	return codec;
+}
+
+void deleteCodecContext(CodecContext* codec) {
+	if (!codec) return;
+	if (codec->inflaterReady) inflateEnd(&(codec->inflater));
+	deleteLzssDecoder(codec->lzss);
+	deleteHuffmanDecoder(codec->huffman);
+	free(codec->output);
+	free(codec->input);
+	free(codec);
+}
+
+/// Grows at least twice as big, so a run of slowly growing entries is cheap.
+static byte* growBuffer(byte** buffer, u32* bufferSize, u32 size) {
+	if (size > *bufferSize || *buffer == NULL) {
+		u32 newSize = size;
+		if (*bufferSize <= 0x7FFFFFFF && *bufferSize * 2 > newSize) newSize = *bufferSize * 2;
+		free(*buffer);
+		/// malloc(0) may return NULL.
+		*buffer = malloc(newSize > 0 ? newSize : 1);
+		*bufferSize = *buffer ? newSize : 0;
+	}
+	return *buffer;
+}
+
+byte* ccOutputBuffer(CodecContext* codec, u32 size) {
+	return growBuffer(&(codec->output), &(codec->outputSize), size);
+}
+
+byte* ccInputBuffer(CodecContext* codec, u32 size) {
+	return growBuffer(&(codec->input), &(codec->inputSize), size);
+}
+
+z_stream* ccInflater(CodecContext* codec) {
+	z_stream* zs = &(codec->inflater);
+	if (codec->inflaterReady) {
+		if (inflateReset(zs) != Z_OK) return NULL;
+	} else {
+		memset(zs, 0, sizeof(z_stream));
+		if (inflateInit(zs) != Z_OK) return NULL;
+		codec->inflaterReady = true;
+	}
+	return zs;
+}
+
+bool ccInflate(CodecContext* codec, const byte* input, u32 inputLen, byte* output, u32 outputLen) {
+	z_stream* zs = ccInflater(codec);
+	if (zs == NULL) return false;
+	zs->next_in = (Bytef*)input;
+	zs->avail_in = inputLen;
+	zs->next_out = output;
+	zs->avail_out = outputLen;
+	return inflate(zs, Z_FINISH) == Z_STREAM_END && zs->total_out == outputLen;
+}
+
+LzssDecoder* ccLzssDecoder(CodecContext* codec) {
+	if (codec->lzss == NULL) codec->lzss = newLzssDecoder();
+	return codec->lzss;
+}
+
+HuffmanDecoder* ccHuffmanDecoder(CodecContext* codec) {
+	if (codec->huffman == NULL) codec->huffman = newHuffmanDecoder();
+	return codec->huffman;
+}
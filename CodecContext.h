@@ -0,0 +1,48 @@
+/**
+ * @file		CodecContext.h
+ * @brief		The decoders and scratch buffers of one worker, kept and reused
+ * 				for every entry the worker decodes.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef CODEC_CONTEXT_H_INCLUDED
+#define CODEC_CONTEXT_H_INCLUDED
+
+#include <zlib.h>
+
+#include "CommonDef.h"
+#include "LzssCode.h"
+#include "HuffmanCode.h"
+
+/**
+ * Everything is set up on first use, so a context costs little until the
+ * package turns out to need it. One context must not be used by several
+ * threads at once.
+ */
+#ifndef CODEC_CONTEXT_DECLARED
+#define CODEC_CONTEXT_DECLARED
+struct CodecContext;
+typedef struct CodecContext CodecContext;
+#endif
+
+CodecContext* newCodecContext(void);
+void deleteCodecContext(CodecContext* codec);
+
+/**
+ * Scratch buffers of at least size bytes, for the decoded and the encoded
+ * data. They are only grown, and their content is not kept when they are.
+ */
+byte* ccOutputBuffer(CodecContext* codec, u32 size);
+byte* ccInputBuffer(CodecContext* codec, u32 size);
+
+/// The inflate stream, reset for a new entry. NULL if zlib cannot set it up.
+z_stream* ccInflater(CodecContext* codec);
+/// Like uncompress(), the entry has to decode to exactly outputLen bytes.
+bool ccInflate(CodecContext* codec, const byte* input, u32 inputLen, byte* output, u32 outputLen);
+
+LzssDecoder* ccLzssDecoder(CodecContext* codec);
+HuffmanDecoder* ccHuffmanDecoder(CodecContext* codec);
+
+#endif
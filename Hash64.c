@@ -0,0 +1,97 @@
+/**
+ * @file		Hash64.c
+ * @brief		A fast 64-bit non-cryptographic hash (the xxHash64 algorithm).
+ * 				Data is consumed 8 bytes at a time in four independent lanes.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#include <string.h>
+
+#include "Hash64.h"
+
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3 1609587929392839161ULL
+#define PRIME4 9650029242287828579ULL
+#define PRIME5 2870177450012600261ULL
+
+static inline u64 rotl(u64 x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline u64 read64(const byte* p) {
+	u64 value;
+	memcpy(&value, p, 8);
+	return value;
+}
+
+static inline u32 read32(const byte* p) {
+	u32 value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+static inline u64 round64(u64 acc, u64 input) {
+	acc += input * PRIME2;
+	acc = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+static inline u64 mergeRound(u64 acc, u64 value) {
+	acc ^= round64(0, value);
+	return acc * PRIME1 + PRIME4;
+}
+
+u64 hash64(const void* data, u64 length, u64 seed) {
+	const byte* p = data;
+	const byte* end = p + length;
+	u64 hash;
+
+	if (length >= 32) {
+		const byte* limit = end - 32;
+		u64 v1 = seed + PRIME1 + PRIME2;
+		u64 v2 = seed + PRIME2;
+		u64 v3 = seed;
+		u64 v4 = seed - PRIME1;
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	} else {
+		hash = seed + PRIME5;
+	}
+
+	hash += length;
+	while (p + 8 <= end) {
+		hash ^= round64(0, read64(p));
+		hash = rotl(hash, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		hash ^= (u64)read32(p) * PRIME1;
+		hash = rotl(hash, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		hash ^= (*p) * PRIME5;
+		hash = rotl(hash, 11) * PRIME1;
+		++p;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
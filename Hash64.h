@@ -0,0 +1,16 @@
+/**
+ * @file		Hash64.h
+ * @brief		A fast 64-bit non-cryptographic hash (the xxHash64 algorithm).
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef HASH64_H_INCLUDED
+#define HASH64_H_INCLUDED
+
+#include "CommonDef.h"
+
+u64 hash64(const void* data, u64 length, u64 seed);
+
+#endif
@@ -13,6 +13,21 @@
 #include "ByteArray.h"
 
 ByteArray* huffmanDecode(const wchar_t* treeName, const byte* compressedData, u32 compressedLen, u32 originalLen);
+/// Like huffmanDecode(), but into a buffer of at least originalLen bytes.
+bool huffmanDecodeTo(const wchar_t* treeName, const byte* compressedData, u32 compressedLen, byte* output, u32 originalLen);
+
+/**
+ * A decoder keeps the tree and lookup table between streams, for decoding
+ * many entries without allocating them again. One decoder must not be used
+ * by several threads at once.
+ */
+struct HuffmanDecoder;
+typedef struct HuffmanDecoder HuffmanDecoder;
+
+HuffmanDecoder* newHuffmanDecoder(void);
+void deleteHuffmanDecoder(HuffmanDecoder* decoder);
+bool huffmanDecodeWith(HuffmanDecoder* decoder, const wchar_t* treeName,
+		const byte* compressedData, u32 compressedLen, byte* output, u32 originalLen);
 ByteArray* huffmanEncode(const wchar_t* treeName, const byte* originalData, u32 originalLen);
 
 #endif
@@ -30,13 +30,13 @@ struct TreeNode {
 };
 typedef struct TreeNode TreeNode;
 
-static bool subTreeCreationWorker(const wchar_t* treeName, TreeNode tree[], BitStream* bs, u16* subTreeRoot, u16* freeSlotIndex) {
-	byte rbyte = 0;
-	if (!bsNextBit(bs, &rbyte)) {
+static bool subTreeCreationWorker(const wchar_t* treeName, TreeNode tree[], BitReader* reader, u16* subTreeRoot, u16* freeSlotIndex) {
+	u32 rbits = 0;
+	if (!brRead(reader, 1, &rbits)) {
 		writeLog(LOG_QUIET, L"ERROR: Unable to generate huffman tree for %s: encoded data exhausted!", treeName);
 		return false;
 	}
-	if (rbyte) {
+	if (rbits) {
 		/**
 		 * An '1' means we should recursively generate the subtrees of the
 		 * current node (preorder traversal indeed).
@@ -48,10 +48,10 @@ static bool subTreeCreationWorker(const wchar_t* treeName, TreeNode tree[], BitS
 			return false;
 		}
 		u16 childRoot = 0;
-		if (!subTreeCreationWorker(treeName, tree, bs, &childRoot, freeSlotIndex))
+		if (!subTreeCreationWorker(treeName, tree, reader, &childRoot, freeSlotIndex))
 			return false;
 		tree[*subTreeRoot].lchild = childRoot;
-		if (!subTreeCreationWorker(treeName, tree, bs, &childRoot, freeSlotIndex))
+		if (!subTreeCreationWorker(treeName, tree, reader, &childRoot, freeSlotIndex))
 			return false;
 		tree[*subTreeRoot].rchild = childRoot;
 		return true;
@@ -62,21 +62,21 @@ static bool subTreeCreationWorker(const wchar_t* treeName, TreeNode tree[], BitS
 		 * A Leaf node's value is stored directly in its parent's links.
 		 * So for this subtree we just return the byte value + 1024.
 		 */
-		if (!bsNextByte(bs, &rbyte)) {
+		if (!brRead(reader, 8, &rbits)) {
 			writeLog(LOG_QUIET,L"ERROR: Cannot generate huffman tree for %s: encoded data exhausted!", treeName);
 			return false;
 		}
-		*subTreeRoot = rbyte + 1024;
+		*subTreeRoot = rbits + 1024;
 		return true;
 	}
 	return false;
 }
 
-static bool createTree(const wchar_t* treeName, TreeNode tree[], BitStream* bs) {
+static bool createTree(const wchar_t* treeName, TreeNode tree[], BitReader* reader) {
 	writeLog(LOG_VERBOSE, L"Creating huffman tree for %s...", treeName);
 	u16 treeRoot = 0;
 	u16 freeSlotIndex = 0;
-	subTreeCreationWorker(treeName, tree, bs, &treeRoot, &freeSlotIndex);
+	subTreeCreationWorker(treeName, tree, reader, &treeRoot, &freeSlotIndex);
 	/**
 	 * The return tree root will not be 0 if it is a tree with only one node,
 	 * which means the tree is corrupted.
@@ -92,51 +92,103 @@ static bool createTree(const wchar_t* treeName, TreeNode tree[], BitStream* bs)
 	return true;
 }
 
-static ByteArray* decodeWithTree(const wchar_t* treeName, TreeNode tree[], BitStream* data, u32 originalLen) {
-	u16 treeIndex = 0;
-	u32 resIndex = 0;
-	byte rbyte = 0;
-	ByteArray* result = newByteArray(originalLen);
+/**
+ * Codes are looked up LOOKUP_BITS bits at a time. An entry holds the leaf
+ * (value + 1024) that the bits lead to and how many of them its code takes,
+ * or, for the longer codes, the internal node reached after all LOOKUP_BITS
+ * bits, from where the tree is walked bit by bit.
+ */
+#define LOOKUP_BITS 11
+#define LOOKUP_SIZE (1 << LOOKUP_BITS)
 
-	while (true) {
-		if (!bsNextBit(data, &rbyte)) {
-			writeLog(LOG_QUIET, L"ERROR: Cannot decode the huffman code for %s: encoded data exhausted!", treeName);
-			return false;
-		}
+struct LookupEntry {
+	u16 node;
+	u16 length;
+};
+typedef struct LookupEntry LookupEntry;
 
-		if (rbyte) {
-			treeIndex = tree[treeIndex].rchild;
-		} else {
-			treeIndex = tree[treeIndex].lchild;
+/// The tree and the table are rebuilt for every stream, but not reallocated.
+struct HuffmanDecoder {
+	TreeNode tree[256];
+	LookupEntry table[LOOKUP_SIZE];
+};
+
+static void fillLookup(LookupEntry table[], const TreeNode tree[], u16 node, u32 code, u32 depth) {
+	if (node >= 1024 || depth == LOOKUP_BITS) {
+		/// Every index starting with this code, whatever the bits after it.
+		u32 first = code << (LOOKUP_BITS - depth);
+		u32 count = 1 << (LOOKUP_BITS - depth);
+		for (u32 i = 0; i < count; ++i) {
+			table[first + i].node = node;
+			table[first + i].length = depth;
 		}
+		return;
+	}
+	fillLookup(table, tree, tree[node].lchild, code << 1, depth + 1);
+	fillLookup(table, tree, tree[node].rchild, (code << 1) | 1, depth + 1);
+}
+
+static bool decodeWithTable(const wchar_t* treeName, HuffmanDecoder* decoder, const BitReader* treeEnd, byte* resData, u32 originalLen) {
+	/// A copy of our own, which the compiler can keep in registers.
+	BitReader reader = *treeEnd;
+	const TreeNode* tree = decoder->tree;
+	const LookupEntry* table = decoder->table;
+	fillLookup(decoder->table, tree, 0, 0, 0);
 
-		if (treeIndex >= 1024) {
-			/// Byte value
-			baData(result)[resIndex++] = treeIndex - 1024;
-			treeIndex = 0;
-
-			/**
-			 * The encoded data may not take up whole bytes, so there would be
-			 * some unused bits in the source array. To determine whether we have
-			 * decoded all the data we needed, we just do the following:
-			 */
-			if (resIndex == originalLen) {
-				return result;
+	for (u32 resIndex = 0; resIndex < originalLen; ++resIndex) {
+		brRefill(&reader);
+		u16 treeIndex = 0;
+		if (brAvailable(&reader) >= LOOKUP_BITS) {
+			const LookupEntry* entry = &table[brPeek(&reader, LOOKUP_BITS)];
+			brConsume(&reader, entry->length);
+			treeIndex = entry->node;
+		}
+		/// A long code, or the last few bits of the data.
+		while (treeIndex < 1024) {
+			if (brAvailable(&reader) == 0) {
+				writeLog(LOG_QUIET, L"ERROR: Cannot decode the huffman code for %s: encoded data exhausted!", treeName);
+				return false;
 			}
+			treeIndex = brPeek(&reader, 1) ? tree[treeIndex].rchild : tree[treeIndex].lchild;
+			brConsume(&reader, 1);
+			brRefill(&reader);
 		}
+		/// Byte value
+		resData[resIndex] = treeIndex - 1024;
 	}
-	return NULL;
+	return true;
+}
+
+HuffmanDecoder* newHuffmanDecoder(void) {
+	return malloc(sizeof(HuffmanDecoder));
+}
+
+void deleteHuffmanDecoder(HuffmanDecoder* decoder) {
+	if (!decoder) return;
+	free(decoder);
+}
+
+bool huffmanDecodeWith(HuffmanDecoder* decoder, const wchar_t* treeName,
+		const byte* compressedData, u32 compressedLen, byte* output, u32 originalLen) {
+	BitReader reader;
+	brInit(&reader, compressedData, compressedLen);
+	memset(decoder->tree, 0, sizeof(decoder->tree));
+	if (!createTree(treeName, decoder->tree, &reader)) return false;
+	return decodeWithTable(treeName, decoder, &reader, output, originalLen);
+}
+
+bool huffmanDecodeTo(const wchar_t* treeName, const byte* compressedData, u32 compressedLen, byte* output, u32 originalLen) {
+	HuffmanDecoder* decoder = newHuffmanDecoder();
+	bool result = huffmanDecodeWith(decoder, treeName, compressedData, compressedLen, output, originalLen);
+	deleteHuffmanDecoder(decoder);
+	return result;
 }
 
 ByteArray* huffmanDecode(const wchar_t* treeName, const byte* compressedData, u32 compressedLen, u32 originalLen) {
-	TreeNode tree[256];
-	BitStream* bs = newBitStream((byte*)compressedData, compressedLen);
-	memset(tree, 0, sizeof(TreeNode) * 256);
-	if (!createTree(treeName, tree, bs)) {
-		deleteBitStream(bs);
+	ByteArray* result = newByteArray(originalLen);
+	if (!huffmanDecodeTo(treeName, compressedData, compressedLen, baData(result), originalLen)) {
+		deleteByteArray(result);
 		return NULL;
 	}
-	ByteArray* result = decodeWithTree(treeName, tree, bs, originalLen);
-	deleteBitStream(bs);
 	return result;
 }
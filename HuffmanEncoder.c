@@ -6,9 +6,9 @@
  * @date		2010.02
  */
 
+#include <stdlib.h>
 #include <string.h>
 
-#include "MinHeap.h"
 #include "Logger.h"
 #include "BitStream.h"
 #include "HuffmanCode.h"
@@ -22,105 +22,212 @@ struct TreeNode {
 };
 typedef struct TreeNode TreeNode;
 
+/**
+ * Four separate tables, so that runs of the same byte value do not keep
+ * waiting on the one counter they all increment.
+ */
+static void countBytes(TreeNode tree[], const byte* data, u32 length) {
+	u32 counts[4][256];
+	memset(counts, 0, sizeof(counts));
+	u32 i = 0;
+	for (; i + 8 <= length; i += 8) {
+		u32 a, b;
+		memcpy(&a, data + i, 4);
+		memcpy(&b, data + i + 4, 4);
+		++counts[0][a & 0xFF];
+		++counts[1][(a >> 8) & 0xFF];
+		++counts[2][(a >> 16) & 0xFF];
+		++counts[3][a >> 24];
+		++counts[0][b & 0xFF];
+		++counts[1][(b >> 8) & 0xFF];
+		++counts[2][(b >> 16) & 0xFF];
+		++counts[3][b >> 24];
+	}
+	for (; i < length; ++i) {
+		++counts[0][data[i]];
+	}
+	for (u16 v = 0; v < 256; ++v) {
+		tree[v].weight = counts[0][v] + counts[1][v] + counts[2][v] + counts[3][v];
+	}
+}
+
+struct Leaf {
+	u32 weight;
+	u16 index;
+};
+typedef struct Leaf Leaf;
+
+static int compareLeaves(const void* a, const void* b) {
+	const Leaf* la = a;
+	const Leaf* lb = b;
+	if (la->weight != lb->weight) return la->weight < lb->weight ? -1 : 1;
+	return (int)la->index - (int)lb->index;
+}
+
+/**
+ * Takes the lighter of the next leaf and the next internal node, a leaf
+ * when they weigh the same.
+ */
+static u16 takeLightest(TreeNode tree[], const Leaf leaves[], u32 leafCount, u32* nextLeaf, u16* nextNode) {
+	if (*nextLeaf < leafCount && leaves[*nextLeaf].weight <= tree[*nextNode].weight)
+		return leaves[(*nextLeaf)++].index;
+	return (*nextNode)++;
+}
+
 static u32 buildTree(const wchar_t* treeName, TreeNode tree [], const byte* originalData, u32 originalLen) {
 	writeLog(LOG_VERBOSE, L"Counting byte values.......");
 	/// The first 256 nodes are leaves that represent byte values.
-	for (u32 i = 0; i < originalLen; ++i) {
-		++(tree[originalData[i]].weight);
-	}
+	countBytes(tree, originalData, originalLen);
 
-	/// Generate the other nodes.
-	MinHeap* heap = newMinHeap(256);
+	Leaf leaves[256];
+	u32 leafCount = 0;
 	for (u16 i = 0; i < 256; ++i) {
 		/// Byte values that don't appear in the data are ignored.
 		if (tree[i].weight > 0) {
-			heapInsert(heap, i, tree[i].weight);
+			leaves[leafCount].weight = tree[i].weight;
+			leaves[leafCount++].index = i;
 			writeLog(LOG_VERBOSE, L"  Byte: %x, Count: %u", i, tree[i].weight);
 		}
 	}
+	/**
+	 * A tree of a single leaf gives that byte an empty code, and the decoder
+	 * cannot tell such a tree from a corrupted one. An unused byte value is
+	 * added as a sibling, so the byte gets a 1-bit code.
+	 */
+	if (leafCount == 1) {
+		leaves[1] = leaves[0];
+		leaves[0].weight = 0;
+		leaves[0].index = leaves[1].index ^ 1;
+		leafCount = 2;
+	}
+	qsort(leaves, leafCount, sizeof(Leaf), compareLeaves);
 
+	/**
+	 * The internal nodes are made in order of weight, so they form a second
+	 * sorted queue, and the two lightest nodes are always at the heads of
+	 * the two queues.
+	 */
 	writeLog(LOG_VERBOSE, L"Generating Tree.......");
-	u16 index = 256;
-	while (heapElementCount(heap) > 1) {
-		u32 ia, ib, wa, wb;
-		heapPopMin(heap, &ia, &wa);
-		heapPopMin(heap, &ib, &wb);
+	u32 nextLeaf = 0;
+	u16 nextNode = 256;
+	u16 rootIndex = 256 + leafCount - 2;
+	for (u16 index = 256; index <= rootIndex; ++index) {
+		/// Unmade nodes must never be taken, make them look heavy.
+		tree[index].weight = 0xFFFFFFFF;
+		u16 ia = takeLightest(tree, leaves, leafCount, &nextLeaf, &nextNode);
+		u16 ib = takeLightest(tree, leaves, leafCount, &nextLeaf, &nextNode);
 		tree[index].lchild = ia;
 		tree[index].rchild = ib;
-		tree[index].weight = wa + wb;
+		tree[index].weight = tree[ia].weight + tree[ib].weight;
 		tree[ia].parent = index;
 		tree[ia].isrchild = false;
 		tree[ib].parent = index;
 		tree[ib].isrchild = true;
-		heapInsert(heap, index, wa + wb);
-		++index;
 	}
-	u32 rootIndex, rootWeight;
-	heapPopMin(heap, &rootIndex, &rootWeight);
-	deleteMinHeap(heap);
 	writeLog(LOG_VERBOSE, L"Tree root is at Index %u.", rootIndex);
 	return rootIndex;
 }
 
-static void subtreeEncodingWorker(const wchar_t* treeName, TreeNode tree[], u32 rootIndex, BitStream* bs) {
+/**
+ * A code is kept as its bits in the low end of value, the bit nearest to
+ * the root being the most significant one. Huffman codes over 32-bit counts
+ * are shorter than 64 bits.
+ */
+struct HuffmanCode {
+	u64 value;
+	u32 length;
+};
+typedef struct HuffmanCode HuffmanCode;
+
+static inline bool putCode(BitWriter* writer, const HuffmanCode* code) {
+	if (code->length > 32) {
+		return bwPut(writer, code->value >> 32, code->length - 32)
+				&& bwPut(writer, (u32)code->value, 32);
+	}
+	return bwPut(writer, (u32)code->value, code->length);
+}
+
+static bool subtreeEncodingWorker(const wchar_t* treeName, TreeNode tree[], u32 rootIndex, BitWriter* writer) {
 	if (rootIndex < 256) {
-		bsSetNextBit(bs, 0);
-		bsSetNextByte(bs, rootIndex);
-	} else {
-		bsSetNextBit(bs, 1);
-		subtreeEncodingWorker(treeName, tree, tree[rootIndex].lchild, bs);
-		subtreeEncodingWorker(treeName, tree, tree[rootIndex].rchild, bs);
+		/// A 0 bit, then the byte value.
+		return bwPut(writer, rootIndex, 9);
 	}
+	return bwPut(writer, 1, 1)
+			&& subtreeEncodingWorker(treeName, tree, tree[rootIndex].lchild, writer)
+			&& subtreeEncodingWorker(treeName, tree, tree[rootIndex].rchild, writer);
 }
 
-static void encodeTree(const wchar_t* treeName, TreeNode tree[], u32 rootIndex, BitStream* bs) {
+static bool encodeTree(const wchar_t* treeName, TreeNode tree[], u32 rootIndex, BitWriter* writer) {
 	writeLog(LOG_VERBOSE, L"Encoding the tree itself......");
-	subtreeEncodingWorker(treeName, tree, rootIndex, bs);
+	if (!subtreeEncodingWorker(treeName, tree, rootIndex, writer)) return false;
 	writeLog(LOG_VERBOSE, L"Tree Encoded.");
+	return true;
 }
 
-static void encodeData(const wchar_t* treeName, TreeNode tree[], u32 rootIndex, const byte* data, u32 oriLen, BitStream* bs) {
-	writeLog(LOG_VERBOSE, L"Encoding data.......");
-	u8 code[256][256];
-	u8 codeLen[256];
-	memset(code, 0, 256 * 256);
-	memset(codeLen, 0, 256);
-
+/// Returns the bit count of the encoded tree and data.
+static u64 generateCodes(TreeNode tree[], u32 rootIndex, HuffmanCode codes[]) {
+	/// Every leaf takes 9 bits in the tree, every internal node 1.
+	u32 internalCount = rootIndex >= 256 ? rootIndex - 255 : 0;
+	u64 bitCount = 10 * internalCount + 9;
 	for (u16 i = 0; i < 256; ++i) {
+		codes[i].value = 0;
+		codes[i].length = 0;
 		if (tree[i].weight == 0) continue;
 		u16 index = i;
 		while (index != rootIndex) {
-			code[i][codeLen[i]++] = tree[index].isrchild;
+			codes[i].value |= (u64)tree[index].isrchild << codes[i].length;
+			++(codes[i].length);
 			index = tree[index].parent;
 		}
+		bitCount += (u64)tree[i].weight * codes[i].length;
 	}
+	return bitCount;
+}
 
-	writeLog(LOG_VERBOSE, L"Huffman codes for individual bytes are generated.");
-
+static bool encodeData(const wchar_t* treeName, const HuffmanCode codes[], const byte* data, u32 oriLen, BitWriter* writer) {
+	writeLog(LOG_VERBOSE, L"Encoding data.......");
 	for (u32 i = 0; i < oriLen; ++i) {
-		u8* thisCode = code[data[i]];
-		for (i16 j = codeLen[data[i]] - 1; j >= 0; --j) {
-			bsSetNextBit(bs, thisCode[j]);
-		}
+		if (!putCode(writer, &codes[data[i]])) return false;
 	}
+	if (!bwFlush(writer)) return false;
 	writeLog(LOG_VERBOSE, L"Data Encoded.");
+	return true;
 }
 
 ByteArray* huffmanEncode(const wchar_t* treeName, const byte* originalData, u32 originalLen) {
+	if (originalLen == 0) {
+		writeLog(LOG_QUIET, L"ERROR: Cannot generate huffman codes for %s: no data!", treeName);
+		return NULL;
+	}
 	writeLog(LOG_VERBOSE, L"Generating Huffman Codes for: %s", treeName);
 	/// At most 256 leaves, and 255 internal nodes, but 512 just looks nicer. ;)
 	TreeNode tree[512];
 	memset(tree, 0, sizeof(tree));
 	u32 rootIndex = buildTree(treeName, tree, originalData, originalLen);
-	ByteArray* encodedData = newByteArray(2 * originalLen);
-	BitStream* encodedStream = newBitStream(baData(encodedData), 2 * originalLen);
-	encodeTree(treeName, tree, rootIndex, encodedStream);
-	encodeData(treeName, tree, rootIndex, originalData, originalLen, encodedStream);
-	u32 encodedLen = bsGetCurrentByteIndex(encodedStream) + 1;
+	HuffmanCode codes[256];
+	u64 bitCount = generateCodes(tree, rootIndex, codes);
+	writeLog(LOG_VERBOSE, L"Huffman codes for individual bytes are generated.");
+
+	/**
+	 * NeXaS always stores one byte more than the last full byte of bits,
+	 * even when the bits end on a byte boundary, and so do we.
+	 */
+	u64 encodedLen = bitCount / 8 + 1;
+	if (encodedLen > 0xFFFFFFFF) {
+		writeLog(LOG_QUIET, L"ERROR: Cannot generate huffman codes for %s: data too long!", treeName);
+		return NULL;
+	}
 	ByteArray* resultData = newByteArray(encodedLen);
-	memcpy(baData(resultData), baData(encodedData), encodedLen);
-	deleteBitStream(encodedStream);
-	deleteByteArray(encodedData);
+	baData(resultData)[encodedLen - 1] = 0;
+	BitWriter writer;
+	bwInit(&writer, baData(resultData), encodedLen);
+	if (!encodeTree(treeName, tree, rootIndex, &writer)
+			|| !encodeData(treeName, codes, originalData, originalLen, &writer)) {
+		/// Should not happen, as the size is exact.
+		writeLog(LOG_QUIET, L"ERROR: Cannot generate huffman codes for %s: output size miscalculated!", treeName);
+		deleteByteArray(resultData);
+		return NULL;
+	}
 	writeLog(LOG_VERBOSE, L"Generated Huffman Codes for: %s", treeName);
 	return resultData;
 }
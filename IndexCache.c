@@ -0,0 +1,244 @@
+/**
+ * @file		IndexCache.c
+ * @brief		A sidecar file (package.pac.pacidx) that keeps the decoded
+ * 				index of a package, so it needs not be decoded again.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+/**
+ * The cache file is laid out as:
+ *
+ * CacheHeader
+ * IndexEntry[entryCount]       -- the decoded index, exactly as in the package
+ * name table slots             -- see NameTable.c, slotsSize bytes
+ * wchar_t[entryCount][64]      -- the names, converted from Shift-JIS
+ * char[entryCount][192]        -- the names again, in UTF-8
+ *
+ * Every part has a fixed size, so the file is used straight from a mapping.
+ * The cache is only meant for the machine that made it, so native byte
+ * order and sizeof(wchar_t) are fine.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <sys/stat.h>
+
+#include "Logger.h"
+#include "StringUtils.h"
+#include "MappedFile.h"
+#include "Hash64.h"
+#include "IndexCache.h"
+
+#define CACHE_MAGIC "ZBSPIDX"
+/// Version 2: the name table ignores case.
+#define CACHE_VERSION 2
+#define WIDE_NAME_LEN 64
+#define UTF8_NAME_LEN 192
+/// The encoded index and its length are at the end of the package.
+#define TAIL_HASH_LEN (64 * 1024)
+
+struct CacheHeader {
+	char magic[8];
+	u32 version;
+	u32 entryCount;
+	Header header;
+	u32 slotsSize;
+	u64 packageLength;
+	u64 packageTime;
+	u64 tailHash;
+	u32 wideCharSize;
+	u32 reserved;
+};
+typedef struct CacheHeader CacheHeader;
+
+struct IndexCache {
+	MappedFile* map;
+	const CacheHeader* header;
+	const IndexEntry* entries;
+	NameTable* table;
+	const wchar_t* wideNames;
+	const char* utf8Names;
+};
+
+static wchar_t* cachePath(const wchar_t* packagePath) {
+	return wcsAppend(packagePath, L".pacidx");
+}
+
+static u64 cacheLength(u32 entryCount, u32 slotsSize) {
+	return sizeof(CacheHeader) + (u64)entryCount * sizeof(IndexEntry) + slotsSize
+			+ (u64)entryCount * WIDE_NAME_LEN * sizeof(wchar_t)
+			+ (u64)entryCount * UTF8_NAME_LEN;
+}
+
+bool stampPackage(const wchar_t* packagePath, PackageStamp* stamp) {
+	struct _stat64 st;
+	if (_wstat64(packagePath, &st) != 0) return false;
+	stamp->length = st.st_size;
+	stamp->modifiedTime = st.st_mtime;
+
+	FILE* file = _wfopen(packagePath, L"rb");
+	if (!file) return false;
+	u32 tailLen = stamp->length < TAIL_HASH_LEN ? stamp->length : TAIL_HASH_LEN;
+	byte* tail = malloc(tailLen + 1);
+	bool result = _fseeki64(file, stamp->length - tailLen, SEEK_SET) == 0
+			&& fread(tail, 1, tailLen, file) == tailLen;
+	fclose(file);
+	if (result)
+		stamp->tailHash = hash64(tail, tailLen, stamp->length);
+	free(tail);
+	return result;
+}
+
+IndexCache* openIndexCache(const wchar_t* packagePath, const Header* header, const PackageStamp* stamp) {
+	wchar_t* path = cachePath(packagePath);
+	MappedFile* map = openMappedFile(path);
+	free(path);
+	if (!map) {
+		writeLog(LOG_VERBOSE, L"No index cache found.");
+		return NULL;
+	}
+
+	const CacheHeader* cacheHeader = (const CacheHeader*)mfData(map);
+	if (mfLength(map) < sizeof(CacheHeader)
+			|| memcmp(cacheHeader->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+			|| cacheHeader->version != CACHE_VERSION
+			|| cacheHeader->wideCharSize != sizeof(wchar_t)
+			|| mfLength(map) != cacheLength(cacheHeader->entryCount, cacheHeader->slotsSize)) {
+		writeLog(LOG_VERBOSE, L"The index cache is invalid, it will be rebuilt.");
+		closeMappedFile(map);
+		return NULL;
+	}
+
+	if (memcmp(&(cacheHeader->header), header, sizeof(Header)) != 0
+			|| cacheHeader->entryCount != header->entryCount
+			|| cacheHeader->packageLength != stamp->length
+			|| cacheHeader->packageTime != stamp->modifiedTime
+			|| cacheHeader->tailHash != stamp->tailHash) {
+		writeLog(LOG_VERBOSE, L"The index cache is stale, it will be rebuilt.");
+		closeMappedFile(map);
+		return NULL;
+	}
+
+	IndexCache* cache = malloc(sizeof(IndexCache));
+	const byte* data = mfData(map) + sizeof(CacheHeader);
+	u32 count = cacheHeader->entryCount;
+	cache->map = map;
+	cache->header = cacheHeader;
+	cache->entries = (const IndexEntry*)data;
+	data += count * sizeof(IndexEntry);
+	cache->table = wrapNameTable(cache->entries[0].name, sizeof(cache->entries[0].name),
+			sizeof(IndexEntry), data, cacheHeader->slotsSize);
+	data += cacheHeader->slotsSize;
+	cache->wideNames = (const wchar_t*)data;
+	data += count * WIDE_NAME_LEN * sizeof(wchar_t);
+	cache->utf8Names = (const char*)data;
+
+	if (cache->table == NULL) {
+		writeLog(LOG_VERBOSE, L"The index cache is invalid, it will be rebuilt.");
+		closeIndexCache(cache);
+		return NULL;
+	}
+	writeLog(LOG_VERBOSE, L"Using the index cache.");
+	return cache;
+}
+
+void closeIndexCache(IndexCache* cache) {
+	if (!cache) return;
+	if (cache->table) deleteNameTable(cache->table);
+	if (cache->map) closeMappedFile(cache->map);
+	free(cache);
+	cache = NULL;
+}
+
+bool saveIndexCache(const wchar_t* packagePath, const Header* header, const PackageStamp* stamp,
+		const IndexEntry* entries, const wchar_t* const* names) {
+	u32 count = header->entryCount;
+	/// Every name must be there, the cache is read without converting them again.
+	for (u32 i = 0; i < count; ++i) {
+		if (names[i] == NULL) {
+			writeLog(LOG_VERBOSE, L"Entry %u has a name that cannot be converted, no index cache.", i);
+			return false;
+		}
+	}
+	NameTable* table = newNameTable(entries[0].name, sizeof(entries[0].name),
+			sizeof(IndexEntry), count);
+	u32 slotsSize = ntSlotsSize(table);
+	u64 length = cacheLength(count, slotsSize);
+
+	byte* data = malloc(length);
+	memset(data, 0, length);
+	CacheHeader* cacheHeader = (CacheHeader*)data;
+	memcpy(cacheHeader->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	cacheHeader->version = CACHE_VERSION;
+	cacheHeader->entryCount = count;
+	cacheHeader->header = *header;
+	cacheHeader->slotsSize = slotsSize;
+	cacheHeader->packageLength = stamp->length;
+	cacheHeader->packageTime = stamp->modifiedTime;
+	cacheHeader->tailHash = stamp->tailHash;
+	cacheHeader->wideCharSize = sizeof(wchar_t);
+
+	byte* part = data + sizeof(CacheHeader);
+	memcpy(part, entries, count * sizeof(IndexEntry));
+	part += count * sizeof(IndexEntry);
+	memcpy(part, ntSlots(table), slotsSize);
+	part += slotsSize;
+	wchar_t* wideNames = (wchar_t*)part;
+	part += count * WIDE_NAME_LEN * sizeof(wchar_t);
+	char* utf8Names = (char*)part;
+	deleteNameTable(table);
+
+	for (u32 i = 0; i < count; ++i) {
+		wcsncpy(wideNames + i * WIDE_NAME_LEN, names[i], WIDE_NAME_LEN - 1);
+		char* utf8Name = toUTF8String(names[i]);
+		if (utf8Name) {
+			strncpy(utf8Names + i * UTF8_NAME_LEN, utf8Name, UTF8_NAME_LEN - 1);
+			free(utf8Name);
+		}
+	}
+
+	/**
+	 * Write to a temporary file first, so no one ever sees a half written
+	 * cache. It is fine to fail here (e.g. read-only media), we just go on
+	 * without the cache.
+	 */
+	wchar_t* path = cachePath(packagePath);
+	wchar_t* tempPath = wcsAppend(path, L".tmp");
+	FILE* file = _wfopen(tempPath, L"wb");
+	bool result = file != NULL && fwrite(data, 1, length, file) == length;
+	if (file) result = (fclose(file) == 0) && result;
+	if (result) {
+		_wremove(path);
+		result = _wrename(tempPath, path) == 0;
+	}
+	if (!result) {
+		_wremove(tempPath);
+		writeLog(LOG_VERBOSE, L"Unable to write the index cache: %s", path);
+	} else {
+		writeLog(LOG_VERBOSE, L"Index cache written: %s", path);
+	}
+	free(tempPath);
+	free(path);
+	free(data);
+	return result;
+}
+
+const IndexEntry* icEntries(const IndexCache* cache) {
+	return cache->entries;
+}
+
+const NameTable* icNameTable(const IndexCache* cache) {
+	return cache->table;
+}
+
+const wchar_t* icWideName(const IndexCache* cache, u32 index) {
+	return cache->wideNames + (size_t)index * WIDE_NAME_LEN;
+}
+
+const char* icUTF8Name(const IndexCache* cache, u32 index) {
+	return cache->utf8Names + (size_t)index * UTF8_NAME_LEN;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file		IndexCache.h
+ * @brief		A sidecar file (package.pac.pacidx) that keeps the decoded
+ * 				index of a package, so it needs not be decoded again.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef INDEX_CACHE_H_INCLUDED
+#define INDEX_CACHE_H_INCLUDED
+
+#include "CommonDef.h"
+#include "NexasFormat.h"
+#include "NameTable.h"
+
+/**
+ * What a cache is valid for. If the package is replaced or modified,
+ * at least one of these would change.
+ */
+struct PackageStamp {
+	u64 length;
+	u64 modifiedTime;
+	u64 tailHash;
+};
+typedef struct PackageStamp PackageStamp;
+
+struct IndexCache;
+typedef struct IndexCache IndexCache;
+
+bool stampPackage(const wchar_t* packagePath, PackageStamp* stamp);
+
+IndexCache* openIndexCache(const wchar_t* packagePath, const Header* header, const PackageStamp* stamp);
+void closeIndexCache(IndexCache* cache);
+bool saveIndexCache(const wchar_t* packagePath, const Header* header, const PackageStamp* stamp,
+		const IndexEntry* entries, const wchar_t* const* names);
+
+const IndexEntry* icEntries(const IndexCache* cache);
+const NameTable* icNameTable(const IndexCache* cache);
+const wchar_t* icWideName(const IndexCache* cache, u32 index);
+const char* icUTF8Name(const IndexCache* cache, u32 index);
+
+#endif
@@ -7,13 +7,51 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <wchar.h>
 #include <stdarg.h>
 
 #include "Logger.h"
 
+/// Most lines fit on the stack, longer ones get a buffer up to LOG_LINE_MAX.
+#define LOG_LINE_LEN 1024
+#define LOG_LINE_MAX 65536
+
 static LogLevel logLevel;
 
+/**
+ * Workers log too, so the line is put together with its line break first
+ * and written in one call, which the C runtime does not let other threads
+ * cut into. An overlong line is cut short.
+ */
+static void writeLine(const wchar_t* str, va_list args) {
+	wchar_t buffer[LOG_LINE_LEN];
+	wchar_t* line = buffer;
+	u32 capacity = LOG_LINE_LEN;
+	for (;;) {
+		va_list copy;
+		va_copy(copy, args);
+		/// Room is kept for the line break.
+		int length = vswprintf(line, capacity - 1, str, copy);
+		va_end(copy);
+		if (length >= 0) {
+			line[length] = L'\n';
+			line[length + 1] = L'\0';
+			break;
+		}
+		if (capacity >= LOG_LINE_MAX) {
+			line[capacity - 2] = L'\n';
+			line[capacity - 1] = L'\0';
+			break;
+		}
+		if (line != buffer) free(line);
+		capacity *= 2;
+		line = malloc(sizeof(wchar_t) * capacity);
+	}
+	fputws(line, stderr);
+	if (line != buffer) free(line);
+}
+
 void setLogLevel(LogLevel level) {
 	logLevel = level;
 }
@@ -23,10 +61,8 @@ void writeLog(LogLevel level, const wchar_t* str, ...) {
 
 	va_list args;
 	va_start(args, str);
-	vfwprintf(stderr, str, args);
+	writeLine(str, args);
 	va_end(args);
-
-	fputwc(L'\n', stderr);
 }
 
 void writeOnlyOnLevel(LogLevel level, const wchar_t* str, ...) {
@@ -34,8 +70,6 @@ void writeOnlyOnLevel(LogLevel level, const wchar_t* str, ...) {
 
 	va_list args;
 	va_start(args, str);
-	vfwprintf(stderr, str, args);
+	writeLine(str, args);
 	va_end(args);
-
-	fputwc(L'\n', stderr);
 }
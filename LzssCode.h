@@ -13,6 +13,55 @@
 #include "ByteArray.h"
 
 ByteArray* lzssDecode(const byte* compressedData, u32 compressedLen, u32 originalLen);
+/// Decodes into a buffer of originalLen bytes, returns how many bytes the data covered.
+u32 lzssDecodeTo(const byte* compressedData, u32 compressedLen, byte* original, u32 originalLen);
+
+/**
+ * Decodes an entry piece by piece, keeping only the 4 KB ring in memory.
+ * lzssDecoderInit() starts a new entry of decodedLen bytes, a decoder can
+ * be reused. lzssDecoderFeed() decodes until the input runs out or the
+ * output is full, tells how much input it took, and returns how much output
+ * it gave. The input it did not take must be fed again. Once the output is
+ * complete it takes nothing more. lzssDecoderFinish() is called after the
+ * last input, repeatedly until it returns 0: it gives out the rest of the
+ * last match, then whatever the encoded data did not cover as zeros, as
+ * with lzssDecodeTo().
+ */
+struct LzssDecoder;
+typedef struct LzssDecoder LzssDecoder;
+
+LzssDecoder* newLzssDecoder(void);
+void deleteLzssDecoder(LzssDecoder* decoder);
+void lzssDecoderInit(LzssDecoder* decoder, u32 decodedLen);
+u32 lzssDecoderFeed(LzssDecoder* decoder, const byte* input, u32 inputLen, u32* consumed,
+		byte* output, u32 outputSize);
+u32 lzssDecoderFinish(LzssDecoder* decoder, byte* output, u32 outputSize);
+/**
+ * How hard the encoder looks for matches. The tree is the original matcher.
+ * The others use hash chains: fast takes the first good match, lazy also
+ * checks whether waiting one byte gives a longer one, optimal picks the
+ * cheapest way to encode each block. All write the same kind of code.
+ */
+enum LzssLevel {
+	LZSS_LEVEL_TREE,
+	LZSS_LEVEL_FAST,
+	LZSS_LEVEL_LAZY,
+	LZSS_LEVEL_OPTIMAL
+};
+typedef enum LzssLevel LzssLevel;
+
+/**
+ * The encoder keeps its trees and buffers in an LzssEncoder, one encoder
+ * must not be used by several threads at once. Reusing an encoder saves
+ * setting it up again for every entry.
+ */
+struct LzssEncoder;
+typedef struct LzssEncoder LzssEncoder;
+
+LzssEncoder* newLzssEncoder(LzssLevel level);
+void deleteLzssEncoder(LzssEncoder* encoder);
+ByteArray* lzssEncodeWith(LzssEncoder* encoder, const byte* originalData, u32 originalLen);
+/// Encodes with a tree encoder of its own, for the odd entry.
 ByteArray* lzssEncode(const byte* originalData, u32 originalLen);
 
 #endif
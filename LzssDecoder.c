@@ -7,6 +7,9 @@
  * @date		2010.03
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "LzssCode.h"
 #include "Logger.h"
 
@@ -14,49 +17,214 @@
 #define MAX_MATCH_LENGTH 18
 #define THRESHOLD 2
 
-static inline byte getBit(byte data, byte offset) {
-	return (data >> (7 - offset)) & 1;
+/**
+ * The decoder needs no window of its own: the ring holds the last
+ * WINDOW_SIZE bytes written, so a position in the ring is just a distance
+ * back into the output. What lies before the start of the output is the
+ * zeros the ring is filled with at first.
+ */
+static inline u32 distanceOf(u32 position, u32 deIndex) {
+	u32 distance = (WINDOW_SIZE - MAX_MATCH_LENGTH + deIndex - position) & (WINDOW_SIZE - 1);
+	/// The slot about to be written still holds the byte from a whole ring ago.
+	return distance ? distance : WINDOW_SIZE;
 }
 
-ByteArray* lzssDecode(const byte* encodedData, u32 encodedLen, u32 decodedLen) {
+/// Copies a match one byte at a time, for overlapping or early matches.
+static inline u32 copyMatch(byte* decodedData, u32 deIndex, u32 distance, u32 length) {
+	for (u32 i = 0; i < length; ++i, ++deIndex) {
+		decodedData[deIndex] = (deIndex >= distance) ? decodedData[deIndex - distance] : 0;
+	}
+	return deIndex;
+}
+
+/**
+ * A group is a flag byte and eight units, 17 bytes at most, and decodes to
+ * 8 * MAX_MATCH_LENGTH bytes at most. Runs of literals are copied 8 bytes
+ * at a time, and matches at least 16 bytes, so up to 7 bytes past the
+ * group may be read, and up to 13 bytes past a match may be written.
+ * Those bytes are overwritten later.
+ */
+#define GROUP_INPUT (17 + 7)
+#define GROUP_OUTPUT (8 * MAX_MATCH_LENGTH + 16)
+
+u32 lzssDecodeTo(const byte* encodedData, u32 encodedLen, byte* decodedData, u32 decodedLen) {
 	u32 enIndex = 0;
 	u32 deIndex = 0;
-	ByteArray* result = newByteArray(decodedLen);
-	byte* decodedData = baData(result);
-
-	byte window[WINDOW_SIZE];
-	for (u32 i = 0; i < WINDOW_SIZE; i++) window[i] = '\0';
 
-	u32 winIndex = WINDOW_SIZE - MAX_MATCH_LENGTH;
+	/// While there is room for a whole group either way, no unit needs checking.
+	while (encodedLen - enIndex >= GROUP_INPUT && decodedLen - deIndex >= GROUP_OUTPUT) {
+		u32 flags = encodedData[enIndex++];
+		if (flags == 0xff) {
+			/// Eight literals, as in data that does not compress.
+			memcpy(decodedData + deIndex, encodedData + enIndex, 8);
+			enIndex += 8;
+			deIndex += 8;
+			continue;
+		}
+		for (u32 units = 8; units > 0; --units, flags >>= 1) {
+			/// The bits above the unused units are 0, so a run stops there.
+			u32 literals = __builtin_ctz(~flags);
+			if (literals > 0) {
+				memcpy(decodedData + deIndex, encodedData + enIndex, 8);
+				enIndex += literals;
+				deIndex += literals;
+				units -= literals;
+				flags >>= literals;
+				if (units == 0) break;
+			}
+			u32 position = encodedData[enIndex] | ((encodedData[enIndex + 1] & 0xf0) << 4);
+			u32 length = (encodedData[enIndex + 1] & 0x0f) + THRESHOLD + 1;
+			enIndex += 2;
+			u32 distance = distanceOf(position, deIndex);
+			byte* dest = decodedData + deIndex;
+			const byte* src = dest - distance;
+			if (distance > deIndex) {
+				deIndex = copyMatch(decodedData, deIndex, distance, length);
+				continue;
+			}
+			if (distance >= 8) {
+				memcpy(dest, src, 8);
+				memcpy(dest + 8, src + 8, 8);
+				if (length > 16)
+					memcpy(dest + 16, src + 16, 8);
+			} else {
+				/**
+				 * The match repeats its first distance bytes. Each step gets
+				 * those right, and the next step starts right after them.
+				 */
+				for (u32 i = 0; i < length; i += distance) {
+					u64 chunk;
+					memcpy(&chunk, src + i, 8);
+					memcpy(dest + i, &chunk, 8);
+				}
+			}
+			deIndex += length;
+		}
+	}
 
-	for (;;) {
-		if (enIndex == encodedLen) break;
+	/// The last few groups, checking every unit.
+	while (enIndex < encodedLen) {
 		byte flags = encodedData[enIndex++];
-		for (int curbit = 7; curbit >= 0; --curbit) {
-			if (getBit(flags, curbit)) {
+		for (int bit = 0; bit < 8; ++bit, flags >>= 1) {
+			if (flags & 1) {
 				if (enIndex == encodedLen || deIndex == decodedLen) goto out;
-				byte data = encodedData[enIndex++];
-				decodedData[deIndex++] = data;
-				window[winIndex++] = data;
-				winIndex &= (WINDOW_SIZE - 1);
+				decodedData[deIndex++] = encodedData[enIndex++];
 			} else {
-				if (enIndex == encodedLen) goto out;
-				u32 position = encodedData[enIndex++];
-				if (enIndex == encodedLen) goto out;
-				u32 length = encodedData[enIndex++];
-
-				position |= (length >> 4) << 8;
-				length = (length & 0x0f) + THRESHOLD + 1;
-				for (u32 i = 0; i < length; ++i) {
-					if (deIndex == decodedLen) goto out;
-					byte data = window[(position + i) & (WINDOW_SIZE - 1)];
-					decodedData[deIndex++] = data;
-					window[winIndex++] = data;
-					winIndex &= (WINDOW_SIZE - 1);
-				}
+				if (encodedLen - enIndex < 2) goto out;
+				u32 position = encodedData[enIndex] | ((encodedData[enIndex + 1] & 0xf0) << 4);
+				u32 length = (encodedData[enIndex + 1] & 0x0f) + THRESHOLD + 1;
+				enIndex += 2;
+				if (length > decodedLen - deIndex) length = decodedLen - deIndex;
+				deIndex = copyMatch(decodedData, deIndex, distanceOf(position, deIndex), length);
 			}
 		}
 	}
 	out:
-		return result;
+		/// Whatever the encoded data does not cover is left zeroed.
+		memset(decodedData + deIndex, 0, decodedLen - deIndex);
+		return deIndex;
+}
+
+/**
+ * The streaming decoder does keep the ring, as the output is handed out
+ * piece by piece. It stops in the middle of anything: a group, a match,
+ * even between the two bytes of a position-and-length pair.
+ */
+struct LzssDecoder {
+	byte window[WINDOW_SIZE];
+	u32 winIndex;
+	/// Output bytes still to come before decodedLen is reached.
+	u32 remaining;
+	/// The flags of the current group, above a 1 marking how many are left.
+	u32 flags;
+	/// The first byte of a pair, when its second one is still to come.
+	i32 pairStart;
+	u32 matchPosition;
+	u32 matchLeft;
+};
+
+LzssDecoder* newLzssDecoder(void) {
+	LzssDecoder* decoder = malloc(sizeof(LzssDecoder));
+	lzssDecoderInit(decoder, 0);
+	return decoder;
+}
+
+void deleteLzssDecoder(LzssDecoder* decoder) {
+	free(decoder);
+}
+
+void lzssDecoderInit(LzssDecoder* decoder, u32 decodedLen) {
+	memset(decoder->window, 0, WINDOW_SIZE);
+	decoder->winIndex = WINDOW_SIZE - MAX_MATCH_LENGTH;
+	decoder->remaining = decodedLen;
+	decoder->flags = 1;
+	decoder->pairStart = -1;
+	decoder->matchPosition = 0;
+	decoder->matchLeft = 0;
+}
+
+u32 lzssDecoderFeed(LzssDecoder* decoder, const byte* input, u32 inputLen, u32* consumed,
+		byte* output, u32 outputSize) {
+	u32 inIndex = 0;
+	u32 outIndex = 0;
+	byte* window = decoder->window;
+	u32 winIndex = decoder->winIndex;
+
+	while (outIndex < outputSize && decoder->remaining > 0) {
+		if (decoder->matchLeft > 0) {
+			u32 length = decoder->matchLeft;
+			if (length > outputSize - outIndex) length = outputSize - outIndex;
+			if (length > decoder->remaining) length = decoder->remaining;
+			for (u32 i = 0; i < length; ++i) {
+				byte data = window[(decoder->matchPosition++) & (WINDOW_SIZE - 1)];
+				output[outIndex++] = data;
+				window[winIndex++] = data;
+				winIndex &= (WINDOW_SIZE - 1);
+			}
+			decoder->matchLeft -= length;
+			decoder->remaining -= length;
+			continue;
+		}
+		if (inIndex == inputLen) break;
+		if (decoder->flags == 1) {
+			decoder->flags = input[inIndex++] | 0x100;
+		} else if (decoder->flags & 1) {
+			byte data = input[inIndex++];
+			output[outIndex++] = data;
+			window[winIndex++] = data;
+			winIndex &= (WINDOW_SIZE - 1);
+			--(decoder->remaining);
+			decoder->flags >>= 1;
+		} else if (decoder->pairStart < 0) {
+			decoder->pairStart = input[inIndex++];
+		} else {
+			u32 length = input[inIndex++];
+			decoder->matchPosition = decoder->pairStart | ((length >> 4) << 8);
+			decoder->matchLeft = (length & 0x0f) + THRESHOLD + 1;
+			decoder->pairStart = -1;
+			decoder->flags >>= 1;
+		}
+	}
+
+	decoder->winIndex = winIndex;
+	*consumed = inIndex;
+	return outIndex;
+}
+
+u32 lzssDecoderFinish(LzssDecoder* decoder, byte* output, u32 outputSize) {
+	/// The last match may not have been given out in full yet.
+	u32 consumed = 0;
+	u32 produced = lzssDecoderFeed(decoder, NULL, 0, &consumed, output, outputSize);
+	if (produced > 0) return produced;
+
+	u32 length = decoder->remaining < outputSize ? decoder->remaining : outputSize;
+	memset(output, 0, length);
+	decoder->remaining -= length;
+	return length;
+}
+
+ByteArray* lzssDecode(const byte* encodedData, u32 encodedLen, u32 decodedLen) {
+	ByteArray* result = newByteArray(decodedLen);
+	lzssDecodeTo(encodedData, encodedLen, baData(result), decodedLen);
+	return result;
 }
@@ -7,6 +7,8 @@
  * @date		2010.03
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include "LzssCode.h"
 #include "Logger.h"
@@ -16,15 +18,88 @@
 #define THRESHOLD 2
 #define NIL 4096
 
-/* ring buffer of size N, with extra F-1 bytes to facilitate string comparison */
-byte text_buf[N + F - 1];
-/* binary search tree for string matching */
-i32 lson[N + 1], rson[N + 257], dad[N + 1];
-int match_length;
-int match_position;
-int r;
+/// The hash chains are keyed by the first 3 bytes, the shortest match.
+#define HASH_BITS 14
+#define HASH_SIZE (1 << HASH_BITS)
+/// Like the tree, never reach back into the F bytes ahead in the ring.
+#define MAX_DISTANCE (N - F)
+/**
+ * The lazy level only puts off matches shorter than this. A literal costs
+ * half as much as a pair, so waiting for one more byte of a long match
+ * seldom pays off.
+ */
+#define LAZY_MAX_LENGTH 8
+/// The optimal parse works on this many positions at a time.
+#define PARSE_BLOCK 32768
+
+/// How many earlier positions with the same prefix are tried, per level.
+static const u32 chainLimits[] = { 0, 8, 64, 256 };
+
+/**
+ * What used to be the globals of the original code, so that every thread
+ * can have its own encoder. The trees are set up again for each entry,
+ * which only touches the roots and the parent links.
+ */
+struct LzssEncoder {
+	LzssLevel level;
+	/* ring buffer of size N, with extra F-1 bytes to facilitate string comparison */
+	byte text_buf[N + F - 1];
+	/* binary search tree for string matching */
+	i32 lson[N + 1], rson[N + 257], dad[N + 1];
+	int match_length;
+	int match_position;
+	/// The code is written here first, kept between calls.
+	byte* output;
+	u32 outputSize;
+	/**
+	 * The hash chain matcher sees the data with N - F zeros in front, as
+	 * the decoder does, so a position in this window is the same as the
+	 * position in the ring, modulo N.
+	 */
+	byte* window;
+	u32 windowSize;
+	/// The latest position for each hash, and the one before it with the same hash.
+	i32* head;
+	i32 prev[N];
+	/// The optimal parse: the longest match at each position of a block, and what it costs from there on.
+	u8* matchLens;
+	u16* matchPositions;
+	u32* costs;
+};
+
+LzssEncoder* newLzssEncoder(LzssLevel level) {
+	LzssEncoder* encoder = malloc(sizeof(LzssEncoder));
+	encoder->level = level;
+	encoder->output = NULL;
+	encoder->outputSize = 0;
+	encoder->window = NULL;
+	encoder->windowSize = 0;
+	encoder->head = NULL;
+	encoder->matchLens = NULL;
+	encoder->matchPositions = NULL;
+	encoder->costs = NULL;
+	if (level != LZSS_LEVEL_TREE)
+		encoder->head = malloc(sizeof(i32) * HASH_SIZE);
+	if (level == LZSS_LEVEL_OPTIMAL) {
+		encoder->matchLens = malloc(PARSE_BLOCK);
+		encoder->matchPositions = malloc(sizeof(u16) * PARSE_BLOCK);
+		encoder->costs = malloc(sizeof(u32) * (PARSE_BLOCK + 1));
+	}
+	return encoder;
+}
 
-void InitTree(void)  /* initialize trees */
+void deleteLzssEncoder(LzssEncoder* encoder) {
+	if (!encoder) return;
+	free(encoder->output);
+	free(encoder->window);
+	free(encoder->head);
+	free(encoder->matchLens);
+	free(encoder->matchPositions);
+	free(encoder->costs);
+	free(encoder);
+}
+
+static void InitTree(LzssEncoder* e)  /* initialize trees */
 {
 	/* For i = 0 to N - 1, rson[i] and lson[i] will be the right and
 	   left children of node i.  These nodes need not be initialized.
@@ -34,14 +109,14 @@ void InitTree(void)  /* initialize trees */
 	   for strings that begin with character i.  These are initialized
 	   to NIL.  Note there are 256 trees. */
 
-	for (int i = N + 1; i <= N + 256; ++i) rson[i] = NIL;
-	for (int i = 0; i < N; ++i) dad[i] = NIL;
+	for (int i = N + 1; i <= N + 256; ++i) e->rson[i] = NIL;
+	for (int i = 0; i < N; ++i) e->dad[i] = NIL;
 }
 
-void InsertNode(int r)
+static void InsertNode(LzssEncoder* e, int r)
 	/* Inserts string of length F, text_buf[r..r+F-1], into one of the
 	   trees (text_buf[r]'th tree) and returns the longest-match position
-	   and length via the global variables match_position and match_length.
+	   and length via the encoder fields match_position and match_length.
 	   If match_length = F, then removes the old node in favor of the new
 	   one, because the old one will be deleted sooner.
 	   Note r plays double role, as tree node and position in buffer. */
@@ -49,91 +124,88 @@ void InsertNode(int r)
 	int  i, p, cmp;
 	unsigned char  *key;
 
-	cmp = 1;  key = &text_buf[r];  p = N + 1 + key[0];
-	rson[r] = lson[r] = NIL;  match_length = 0;
+	cmp = 1;  key = &e->text_buf[r];  p = N + 1 + key[0];
+	e->rson[r] = e->lson[r] = NIL;  e->match_length = 0;
 	for ( ; ; ) {
 		if (cmp >= 0) {
-			if (rson[p] != NIL) p = rson[p];
-			else {  rson[p] = r;  dad[r] = p;  return;  }
+			if (e->rson[p] != NIL) p = e->rson[p];
+			else {  e->rson[p] = r;  e->dad[r] = p;  return;  }
 		} else {
-			if (lson[p] != NIL) p = lson[p];
-			else {  lson[p] = r;  dad[r] = p;  return;  }
+			if (e->lson[p] != NIL) p = e->lson[p];
+			else {  e->lson[p] = r;  e->dad[r] = p;  return;  }
 		}
 		for (i = 1; i < F; i++)
-			if ((cmp = key[i] - text_buf[p + i]) != 0)  break;
-		if (i > match_length) {
-			match_position = p;
-			if ((match_length = i) >= F)  break;
+			if ((cmp = key[i] - e->text_buf[p + i]) != 0)  break;
+		if (i > e->match_length) {
+			e->match_position = p;
+			if ((e->match_length = i) >= F)  break;
 		}
 	}
-	dad[r] = dad[p];  lson[r] = lson[p];  rson[r] = rson[p];
-	dad[lson[p]] = r;  dad[rson[p]] = r;
-	if (rson[dad[p]] == p) rson[dad[p]] = r;
-	else                   lson[dad[p]] = r;
-	dad[p] = NIL;  /* remove p */
+	e->dad[r] = e->dad[p];  e->lson[r] = e->lson[p];  e->rson[r] = e->rson[p];
+	e->dad[e->lson[p]] = r;  e->dad[e->rson[p]] = r;
+	if (e->rson[e->dad[p]] == p) e->rson[e->dad[p]] = r;
+	else                   e->lson[e->dad[p]] = r;
+	e->dad[p] = NIL;  /* remove p */
 }
 
-void DeleteNode(int p)  /* deletes node p from tree */
+static void DeleteNode(LzssEncoder* e, int p)  /* deletes node p from tree */
 {
 	int  q;
 
-	if (dad[p] == NIL) return;  /* not in tree */
-	if (rson[p] == NIL) q = lson[p];
-	else if (lson[p] == NIL) q = rson[p];
+	if (e->dad[p] == NIL) return;  /* not in tree */
+	if (e->rson[p] == NIL) q = e->lson[p];
+	else if (e->lson[p] == NIL) q = e->rson[p];
 	else {
-		q = lson[p];
-		if (rson[q] != NIL) {
-			do {  q = rson[q];  } while (rson[q] != NIL);
-			rson[dad[q]] = lson[q];  dad[lson[q]] = dad[q];
-			lson[q] = lson[p];  dad[lson[p]] = q;
+		q = e->lson[p];
+		if (e->rson[q] != NIL) {
+			do {  q = e->rson[q];  } while (e->rson[q] != NIL);
+			e->rson[e->dad[q]] = e->lson[q];  e->dad[e->lson[q]] = e->dad[q];
+			e->lson[q] = e->lson[p];  e->dad[e->lson[p]] = q;
 		}
-		rson[q] = rson[p];  dad[rson[p]] = q;
+		e->rson[q] = e->rson[p];  e->dad[e->rson[p]] = q;
 	}
-	dad[q] = dad[p];
-	if (rson[dad[p]] == p) rson[dad[p]] = q;  else lson[dad[p]] = q;
-	dad[p] = NIL;
+	e->dad[q] = e->dad[p];
+	if (e->rson[e->dad[p]] == p) e->rson[e->dad[p]] = q;  else e->lson[e->dad[p]] = q;
+	e->dad[p] = NIL;
 }
 
-ByteArray* lzssEncode(const byte* originalData, u32 originalLen)
+static u32 encodeWithTree(LzssEncoder* e, const byte* originalData, u32 originalLen, byte* encodedData)
 {
 	int  i, c, len, r, s, last_match_length, code_buf_ptr;
 	byte code_buf[17], mask;
 
-	ByteArray* encodedArray = newByteArray(originalLen);
-	byte* encodedData = baData(encodedArray);
-
 	int enIndex = 0;
 	int oriIndex = 0;
 
-	InitTree();  /* initialize trees */
+	InitTree(e);  /* initialize trees */
 	code_buf[0] = 0;  /* code_buf[1..16] saves eight units of code, and
 		code_buf[0] works as eight flags, "1" representing that the unit
 		is an decoded letter (1 byte), "0" a position-and-length pair
 		(2 bytes).  Thus, eight units require at most 16 bytes of code. */
 	code_buf_ptr = mask = 1;
 	s = 0;  r = N - F;
-	memset(text_buf, 0, N);
+	memset(e->text_buf, 0, N);
 	for (len = 0; len < F && oriIndex < originalLen; ++len)
-		text_buf[r + len] = originalData[oriIndex++];  /* Read F bytes into the last F bytes of
+		e->text_buf[r + len] = originalData[oriIndex++];  /* Read F bytes into the last F bytes of
 			the buffer */
-	for (i = 1; i <= F; i++) InsertNode(r - i);  /* Insert the F strings,
+	for (i = 1; i <= F; i++) InsertNode(e, r - i);  /* Insert the F strings,
 		each of which begins with one or more 'space' characters.  Note
 		the order in which these strings are inserted.  This way,
 		degenerate trees will be less likely to occur. */
-	InsertNode(r);  /* Finally, insert the whole string just read.  The
-		global variables match_length and match_position are set. */
+	InsertNode(e, r);  /* Finally, insert the whole string just read.  The
+		encoder fields match_length and match_position are set. */
 	do {
-		if (match_length > len) match_length = len;  /* match_length
+		if (e->match_length > len) e->match_length = len;  /* match_length
 			may be spuriously long near the end of text. */
-		if (match_length <= THRESHOLD) {
-			match_length = 1;  /* Not long enough match.  Send one byte. */
+		if (e->match_length <= THRESHOLD) {
+			e->match_length = 1;  /* Not long enough match.  Send one byte. */
 			code_buf[0] |= mask;  /* 'send one byte' flag */
-			code_buf[code_buf_ptr++] = text_buf[r];  /* Send uncoded. */
+			code_buf[code_buf_ptr++] = e->text_buf[r];  /* Send uncoded. */
 		} else {
-			code_buf[code_buf_ptr++] = (unsigned char) match_position;
+			code_buf[code_buf_ptr++] = (unsigned char) e->match_position;
 			code_buf[code_buf_ptr++] = (unsigned char)
-				(((match_position >> 4) & 0xf0)
-			  | (match_length - (THRESHOLD + 1)));  /* Send position and
+				(((e->match_position >> 4) & 0xf0)
+			  | (e->match_length - (THRESHOLD + 1)));  /* Send position and
 					length pair. Note match_length > THRESHOLD. */
 		}
 		if ((mask <<= 1) == 0) {  /* Shift mask left one bit. */
@@ -141,31 +213,253 @@ ByteArray* lzssEncode(const byte* originalData, u32 originalLen)
 				encodedData[enIndex++] = code_buf[i];     /* code together */
 			code_buf[0] = 0;  code_buf_ptr = mask = 1;
 		}
-		last_match_length = match_length;
+		last_match_length = e->match_length;
 		for (i = 0; i < last_match_length && oriIndex < originalLen; ++i) {
-			DeleteNode(s);		/* Delete old strings and */
+			DeleteNode(e, s);		/* Delete old strings and */
 			c = originalData[oriIndex++];
-			text_buf[s] = c;	/* read new bytes */
-			if (s < F - 1) text_buf[s + N] = c;  /* If the position is
+			e->text_buf[s] = c;	/* read new bytes */
+			if (s < F - 1) e->text_buf[s + N] = c;  /* If the position is
 				near the end of buffer, extend the buffer to make
 				string comparison easier. */
 			s = (s + 1) & (N - 1);  r = (r + 1) & (N - 1);
 				/* Since this is a ring buffer, increment the position
 				   modulo N. */
-			InsertNode(r);	/* Register the string in text_buf[r..r+F-1] */
+			InsertNode(e, r);	/* Register the string in text_buf[r..r+F-1] */
 		}
 		while (i++ < last_match_length) {	/* After the end of text, */
-			DeleteNode(s);					/* no need to read, but */
+			DeleteNode(e, s);					/* no need to read, but */
 			s = (s + 1) & (N - 1);  r = (r + 1) & (N - 1);
-			if (--len) InsertNode(r);		/* buffer may not be empty. */
+			if (--len) InsertNode(e, r);		/* buffer may not be empty. */
 		}
 	} while (len > 0);	/* until length of string to be processed is zero */
 	if (code_buf_ptr > 1) {		/* Send remaining code. */
 		for (i = 0; i < code_buf_ptr; i++) encodedData[enIndex++] = code_buf[i];
 	}
+	return enIndex;
+}
+
+/**
+ * Writes the units in the same groups as the tree encoder does, a flag
+ * byte followed by up to eight literals or position-and-length pairs.
+ */
+struct CodeWriter {
+	byte* data;
+	u32 length;
+	u32 flagIndex;
+	byte mask;
+};
+typedef struct CodeWriter CodeWriter;
+
+static inline void startUnit(CodeWriter* writer) {
+	if (writer->mask == 0) {
+		writer->flagIndex = writer->length;
+		writer->data[writer->length++] = 0;
+		writer->mask = 1;
+	}
+}
+
+static inline void putLiteral(CodeWriter* writer, byte c) {
+	startUnit(writer);
+	writer->data[writer->flagIndex] |= writer->mask;
+	writer->data[writer->length++] = c;
+	writer->mask <<= 1;
+}
+
+static inline void putMatch(CodeWriter* writer, u32 position, u32 length) {
+	startUnit(writer);
+	position &= N - 1;
+	writer->data[writer->length++] = (byte)position;
+	writer->data[writer->length++] = (byte)(((position >> 4) & 0xf0) | (length - (THRESHOLD + 1)));
+	writer->mask <<= 1;
+}
+
+static inline u32 hash3(const byte* data) {
+	u32 key = ((u32)data[0] << 16) | ((u32)data[1] << 8) | data[2];
+	return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/// Positions whose 3 bytes run past the end are never looked up, nor put in.
+static inline void insertPosition(LzssEncoder* e, u32 pos, u32 end) {
+	if (pos + THRESHOLD >= end) return;
+	u32 h = hash3(e->window + pos);
+	e->prev[pos & (N - 1)] = e->head[h];
+	e->head[h] = pos;
+}
+
+/// Compares 8 bytes at a time, the first differing byte is found from the lowest set bit.
+static inline u32 commonLength(const byte* a, const byte* b, u32 limit) {
+	u32 len = 0;
+	while (len + 8 <= limit) {
+		u64 x, y;
+		memcpy(&x, a + len, 8);
+		memcpy(&y, b + len, 8);
+		u64 diff = x ^ y;
+		if (diff != 0)
+			return len + (__builtin_ctzll(diff) >> 3);
+		len += 8;
+	}
+	while (len < limit && a[len] == b[len]) ++len;
+	return len;
+}
+
+/**
+ * Returns the longest match for the bytes at pos, not running past end,
+ * or 0 if there is none longer than THRESHOLD. The source may overlap pos,
+ * the decoder copies one byte at a time, so that is fine.
+ * pos itself must not be in the chains yet.
+ */
+static u32 findMatch(LzssEncoder* e, u32 pos, u32 end, u32* matchPos) {
+	u32 limit = end - pos;
+	if (limit > F) limit = F;
+	if (limit <= THRESHOLD) return 0;
+
+	const byte* window = e->window;
+	u32 best = THRESHOLD;
+	u32 chain = chainLimits[e->level];
+	i32 candidate = e->head[hash3(window + pos)];
+	while (candidate >= 0 && pos - candidate <= MAX_DISTANCE && chain-- > 0) {
+		/// The byte that would make the match longer has to agree first.
+		if (window[candidate + best] == window[pos + best]) {
+			u32 len = commonLength(window + candidate, window + pos, limit);
+			if (len > best) {
+				best = len;
+				*matchPos = candidate;
+				if (len == limit) break;
+			}
+		}
+		candidate = e->prev[candidate & (N - 1)];
+	}
+	return best > THRESHOLD ? best : 0;
+}
+
+/**
+ * Takes the longest match at each position. With lazy, a short match is
+ * put off by one byte if the next position has a longer one.
+ */
+static void parseGreedy(LzssEncoder* e, u32 end, CodeWriter* writer, bool lazy) {
+	u32 pos = N - F;
+	u32 len = 0;
+	u32 matchPos = 0;
+	bool found = false;
+	while (pos < end) {
+		if (!found) len = findMatch(e, pos, end, &matchPos);
+		found = false;
+		insertPosition(e, pos, end);
+		if (lazy && len > 0 && len < LAZY_MAX_LENGTH) {
+			u32 nextPos = 0;
+			u32 nextLen = findMatch(e, pos + 1, end, &nextPos);
+			if (nextLen > len) {
+				putLiteral(writer, e->window[pos++]);
+				len = nextLen;
+				matchPos = nextPos;
+				found = true;
+				continue;
+			}
+		}
+		if (len == 0) {
+			putLiteral(writer, e->window[pos++]);
+			continue;
+		}
+		putMatch(writer, matchPos, len);
+		for (u32 k = 1; k < len; ++k) {
+			insertPosition(e, pos + k, end);
+		}
+		pos += len;
+	}
+}
+
+/**
+ * A literal always costs 9 bits and a pair 17, wherever it points to, and
+ * any match shorter than the longest one is there too. So knowing the
+ * longest match at each position, the cheapest parse of a block is found
+ * backwards from its end. Matches do not cross the end of a block.
+ */
+static void parseOptimal(LzssEncoder* e, u32 end, CodeWriter* writer) {
+	for (u32 start = N - F; start < end; start += PARSE_BLOCK) {
+		u32 blockEnd = (end - start > PARSE_BLOCK) ? start + PARSE_BLOCK : end;
+		u32 count = blockEnd - start;
+
+		for (u32 i = 0; i < count; ++i) {
+			u32 matchPos = 0;
+			e->matchLens[i] = findMatch(e, start + i, blockEnd, &matchPos);
+			e->matchPositions[i] = matchPos & (N - 1);
+			insertPosition(e, start + i, end);
+		}
+
+		e->costs[count] = 0;
+		for (u32 i = count; i-- > 0; ) {
+			u32 best = 0;
+			e->costs[i] = e->costs[i + 1] + 9;
+			for (u32 len = THRESHOLD + 1; len <= e->matchLens[i]; ++len) {
+				u32 cost = e->costs[i + len] + 17;
+				if (cost < e->costs[i]) {
+					e->costs[i] = cost;
+					best = len;
+				}
+			}
+			/// From here on, the length to take, 0 for a literal.
+			e->matchLens[i] = best;
+		}
+
+		for (u32 i = 0; i < count; ) {
+			if (e->matchLens[i] == 0) {
+				putLiteral(writer, e->window[start + i]);
+				++i;
+			} else {
+				putMatch(writer, e->matchPositions[i], e->matchLens[i]);
+				i += e->matchLens[i];
+			}
+		}
+	}
+}
+
+static u32 encodeWithChains(LzssEncoder* e, const byte* originalData, u32 originalLen, byte* encodedData) {
+	u32 end = N - F + originalLen;
+	if (e->windowSize < end) {
+		free(e->window);
+		e->window = malloc(end);
+		e->windowSize = end;
+	}
+	memset(e->window, 0, N - F);
+	memcpy(e->window + N - F, originalData, originalLen);
+	memset(e->head, 0xff, sizeof(i32) * HASH_SIZE);
+
+	/// Like the tree encoder, the last F positions of the zeros can be matched.
+	for (u32 pos = N - 2 * F; pos < N - F; ++pos) {
+		insertPosition(e, pos, end);
+	}
+
+	CodeWriter writer = { encodedData, 0, 0, 0 };
+	if (e->level == LZSS_LEVEL_OPTIMAL)
+		parseOptimal(e, end, &writer);
+	else
+		parseGreedy(e, end, &writer, e->level == LZSS_LEVEL_LAZY);
+	return writer.length;
+}
+
+ByteArray* lzssEncodeWith(LzssEncoder* e, const byte* originalData, u32 originalLen)
+{
+	/* Every 8 units take one flag byte, so incompressible data grows by 1/8. */
+	u32 maxLen = originalLen + originalLen / 8 + 2;
+	if (e->outputSize < maxLen) {
+		free(e->output);
+		e->output = malloc(maxLen);
+		e->outputSize = maxLen;
+	}
 
-	ByteArray* result = newByteArray(enIndex);
-	memcpy(baData(result), encodedData, enIndex);
-	deleteByteArray(encodedArray);
+	u32 encodedLen = (e->level == LZSS_LEVEL_TREE)
+			? encodeWithTree(e, originalData, originalLen, e->output)
+			: encodeWithChains(e, originalData, originalLen, e->output);
+
+	ByteArray* result = newByteArray(encodedLen);
+	memcpy(baData(result), e->output, encodedLen);
+	return result;
+}
+
+ByteArray* lzssEncode(const byte* originalData, u32 originalLen)
+{
+	LzssEncoder* encoder = newLzssEncoder(LZSS_LEVEL_TREE);
+	ByteArray* result = lzssEncodeWith(encoder, originalData, originalLen);
+	deleteLzssEncoder(encoder);
 	return result;
 }
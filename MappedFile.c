@@ -0,0 +1,128 @@
+/**
+ * @file		MappedFile.c
+ * @brief		A read-only view of a whole file, mapped into memory.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MappedFile.h"
+
+struct MappedFile {
+	HANDLE file;
+	HANDLE mapping;
+	const byte* data;
+	u64 length;
+};
+
+/**
+ * PrefetchVirtualMemory() only exists since Windows 8, so we look it up
+ * at runtime, and simply skip the hint on older systems.
+ */
+struct PrefetchRange {
+	void* address;
+	size_t length;
+};
+typedef struct PrefetchRange PrefetchRange;
+typedef BOOL (WINAPI *PrefetchFunc)(HANDLE, ULONG_PTR, PrefetchRange*, ULONG);
+
+static PrefetchFunc getPrefetchFunc(void) {
+	static PrefetchFunc func = NULL;
+	static volatile LONG resolved = 0;
+	if (!resolved) {
+		HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+		if (kernel)
+			func = (PrefetchFunc)GetProcAddress(kernel, "PrefetchVirtualMemory");
+		InterlockedExchange(&resolved, 1);
+	}
+	return func;
+}
+
+static u32 pageSize(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+MappedFile* openMappedFile(const wchar_t* path) {
+	MappedFile* file = malloc(sizeof(MappedFile));
+	memset(file, 0, sizeof(MappedFile));
+
+	/// The entries are mostly visited front to back, tell the cache manager so.
+	file->file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file->file == INVALID_HANDLE_VALUE) {
+		file->file = NULL;
+		closeMappedFile(file);
+		return NULL;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file->file, &size) || size.QuadPart == 0
+			|| (u64)size.QuadPart > (u64)(size_t)-1) {
+		closeMappedFile(file);
+		return NULL;
+	}
+	file->length = size.QuadPart;
+
+	file->mapping = CreateFileMappingW(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (file->mapping == NULL) {
+		closeMappedFile(file);
+		return NULL;
+	}
+
+	/// This fails when there is not enough address space for the whole file.
+	file->data = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (file->data == NULL) {
+		closeMappedFile(file);
+		return NULL;
+	}
+	return file;
+}
+
+void closeMappedFile(MappedFile* file) {
+	if (!file) return;
+	if (file->data) UnmapViewOfFile((void*)file->data);
+	if (file->mapping) CloseHandle(file->mapping);
+	if (file->file) CloseHandle(file->file);
+	free(file);
+	file = NULL;
+}
+
+const byte* mfData(const MappedFile* file) {
+	return file->data;
+}
+
+u64 mfLength(const MappedFile* file) {
+	return file->length;
+}
+
+bool mfContains(const MappedFile* file, u64 offset, u64 length) {
+	return offset <= file->length && length <= file->length - offset;
+}
+
+void mfWillNeed(const MappedFile* file, u64 offset, u64 length) {
+	PrefetchFunc prefetch = getPrefetchFunc();
+	if (!prefetch || !mfContains(file, offset, length) || length == 0) return;
+	PrefetchRange range = { (void*)(file->data + offset), length };
+	prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
+/**
+ * Unlocking pages that are not locked is a well known trick to drop them
+ * from the working set. The pages stay in the file cache, so touching them
+ * again is cheap, but they no longer count against our memory usage.
+ */
+void mfDontNeed(const MappedFile* file, u64 offset, u64 length) {
+	if (!mfContains(file, offset, length)) return;
+	u64 page = pageSize();
+	u64 begin = (offset + page - 1) / page * page;
+	u64 end = (offset + length) / page * page;
+	if (end <= begin) return;
+	VirtualUnlock((void*)(file->data + begin), end - begin);
+}
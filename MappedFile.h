@@ -0,0 +1,27 @@
+/**
+ * @file		MappedFile.h
+ * @brief		A read-only view of a whole file, mapped into memory.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include "CommonDef.h"
+
+struct MappedFile;
+typedef struct MappedFile MappedFile;
+
+MappedFile* openMappedFile(const wchar_t* path);
+void closeMappedFile(MappedFile* file);
+
+const byte* mfData(const MappedFile* file);
+u64 mfLength(const MappedFile* file);
+bool mfContains(const MappedFile* file, u64 offset, u64 length);
+
+void mfWillNeed(const MappedFile* file, u64 offset, u64 length);
+void mfDontNeed(const MappedFile* file, u64 offset, u64 length);
+
+#endif
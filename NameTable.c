@@ -0,0 +1,153 @@
+/**
+ * @file		NameTable.c
+ * @brief		An open addressing hash table that finds index entries by name.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "NameTable.h"
+
+/**
+ * A slot keeps the full hash so most mismatches are found without
+ * touching the names, and entry index + 1, so that 0 marks a free slot.
+ */
+struct Slot {
+	u32 hash;
+	u32 entry;
+};
+typedef struct Slot Slot;
+
+struct NameTable {
+	const char* names;
+	u32 nameLen;
+	u32 stride;
+	u32 mask;
+	Slot* slots;
+	/// False when the slots belong to someone else, e.g. a mapped index cache.
+	bool ownsSlots;
+};
+
+/// The lead byte of a double-byte Shift-JIS character.
+static inline bool isLeadByte(byte c) {
+	return (c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC);
+}
+
+/**
+ * Names are matched ignoring case, as Windows file names are, and as
+ * unpack does when it decides which of several entries wins. Only ASCII
+ * letters are folded; the second byte of a double-byte character may
+ * look like one, so it is skipped.
+ */
+static inline byte foldByte(byte c, bool trailByte) {
+	return (!trailByte && c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/// FNV-1a over the folded name, good enough for file names.
+static u32 hashName(const char* name, u32 nameLen) {
+	u32 hash = 2166136261u;
+	bool trailByte = false;
+	for (u32 i = 0; i < nameLen && name[i] != '\0'; ++i) {
+		byte c = (byte)name[i];
+		hash ^= foldByte(c, trailByte);
+		hash *= 16777619u;
+		trailByte = !trailByte && isLeadByte(c);
+	}
+	return hash;
+}
+
+static bool sameName(const char* x, const char* y, u32 nameLen) {
+	bool trailByte = false;
+	for (u32 i = 0; i < nameLen; ++i) {
+		byte a = (byte)x[i];
+		byte b = (byte)y[i];
+		if (foldByte(a, trailByte) != foldByte(b, trailByte)) return false;
+		if (a == '\0') return true;
+		trailByte = !trailByte && isLeadByte(a);
+	}
+	return true;
+}
+
+static inline const char* nameAt(const NameTable* table, u32 index) {
+	return table->names + (size_t)index * table->stride;
+}
+
+NameTable* newNameTable(const char* firstName, u32 nameLen, u32 stride, u32 count) {
+	NameTable* table = malloc(sizeof(NameTable));
+	table->names = firstName;
+	table->nameLen = nameLen;
+	table->stride = stride;
+
+	/// Keep the load factor under 1/2, so the probe sequences stay short.
+	u32 capacity = 16;
+	while (capacity < count * 2) capacity <<= 1;
+	table->mask = capacity - 1;
+	table->slots = malloc(sizeof(Slot) * capacity);
+	table->ownsSlots = true;
+	memset(table->slots, 0, sizeof(Slot) * capacity);
+
+	for (u32 i = 0; i < count; ++i) {
+		const char* name = nameAt(table, i);
+		u32 hash = hashName(name, nameLen);
+		u32 pos = hash & table->mask;
+		while (table->slots[pos].entry != 0) {
+			/**
+			 * A name that appears again replaces the earlier entry,
+			 * as the later one is what an unpacked directory ends up with.
+			 */
+			Slot* slot = &(table->slots[pos]);
+			if (slot->hash == hash && sameName(nameAt(table, slot->entry - 1), name, nameLen))
+				break;
+			pos = (pos + 1) & table->mask;
+		}
+		table->slots[pos].hash = hash;
+		table->slots[pos].entry = i + 1;
+	}
+	return table;
+}
+
+NameTable* wrapNameTable(const char* firstName, u32 nameLen, u32 stride, const void* slots, u32 slotsSize) {
+	/// The capacity must be a power of 2.
+	u32 capacity = slotsSize / sizeof(Slot);
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0 || capacity * sizeof(Slot) != slotsSize)
+		return NULL;
+
+	NameTable* table = malloc(sizeof(NameTable));
+	table->names = firstName;
+	table->nameLen = nameLen;
+	table->stride = stride;
+	table->mask = capacity - 1;
+	table->slots = (Slot*)slots;
+	table->ownsSlots = false;
+	return table;
+}
+
+void deleteNameTable(NameTable* table) {
+	if (!table) return;
+	if (table->slots && table->ownsSlots) free(table->slots);
+	free(table);
+	table = NULL;
+}
+
+const void* ntSlots(const NameTable* table) {
+	return table->slots;
+}
+
+u32 ntSlotsSize(const NameTable* table) {
+	return (table->mask + 1) * sizeof(Slot);
+}
+
+i32 ntFind(const NameTable* table, const char* name) {
+	u32 hash = hashName(name, table->nameLen);
+	u32 pos = hash & table->mask;
+	while (table->slots[pos].entry != 0) {
+		const Slot* slot = &(table->slots[pos]);
+		if (slot->hash == hash && sameName(nameAt(table, slot->entry - 1), name, table->nameLen))
+			return slot->entry - 1;
+		pos = (pos + 1) & table->mask;
+	}
+	return -1;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file		NameTable.h
+ * @brief		An open addressing hash table that finds index entries by name.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef NAME_TABLE_H_INCLUDED
+#define NAME_TABLE_H_INCLUDED
+
+#include "CommonDef.h"
+
+struct NameTable;
+typedef struct NameTable NameTable;
+
+/**
+ * The names are fixed length fields (at most nameLen bytes, null-padded),
+ * the first one starts at firstName and the others follow every stride
+ * bytes, so the table can be built right over an array of index entries.
+ */
+NameTable* newNameTable(const char* firstName, u32 nameLen, u32 stride, u32 count);
+void deleteNameTable(NameTable* table);
+
+/**
+ * The slots of a table can be saved as is, and later used again, without
+ * copying, over the same names.
+ */
+NameTable* wrapNameTable(const char* firstName, u32 nameLen, u32 stride, const void* slots, u32 slotsSize);
+const void* ntSlots(const NameTable* table);
+u32 ntSlotsSize(const NameTable* table);
+
+/// Case is ignored, as in Windows file names, see NameTable.c.
+i32 ntFind(const NameTable* table, const char* name);
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @file		NexasFormat.h
+ * @brief		On-disk structures of the PAC files, shared by the packer,
+ * 				the unpacker and the index cache.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef NEXAS_FORMAT_H_INCLUDED
+#define NEXAS_FORMAT_H_INCLUDED
+
+#include "CommonDef.h"
+
+enum VariantType {
+	CONTENT_NOT_COMPRESSED,
+	CONTENT_LZSS,
+	CONTENT_HUFFMAN,
+	CONTENT_DEFLATE,
+	CONTENT_MAYBE_DEFLATE
+};
+
+struct Header {
+	char typeTag[3];
+	byte magicByte;
+	u32 entryCount;
+	u32 variantTag;
+};
+typedef struct Header Header;
+
+struct IndexEntry {
+	char name[64];
+	u32 offset;
+	u32 decodedLen;
+	u32 encodedLen;
+};
+typedef struct IndexEntry IndexEntry;
+
+#endif
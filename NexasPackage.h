@@ -11,7 +11,21 @@
 
 #include "CommonDef.h"
 
-bool unpackPackage(const wchar_t* packagePath, const wchar_t* targetDir);
-bool packPackage(const wchar_t* sourceDir, const wchar_t* packagePath, bool isBfeFormat);
+bool unpackPackage(const wchar_t* packagePath, const wchar_t* targetDir, u32 threadCount);
+bool extractEntries(const wchar_t* packagePath, const wchar_t* const* names, u32 nameCount,
+		const wchar_t* targetDir, u32 threadCount);
+bool catEntry(const wchar_t* packagePath, const wchar_t* name);
+bool listPackage(const wchar_t* packagePath);
+void useIndexCache(bool enabled);
+/// 0 for the original tree matcher, 1 to 3 for the faster or stronger ones, see LzssCode.h.
+void useLzssLevel(u32 level);
+bool patchPackage(const wchar_t* packagePath, const wchar_t* overlayDir);
+bool compactPackage(const wchar_t* packagePath);
+bool mergePackage(const wchar_t* basePath, const wchar_t* overlayDir, const wchar_t* targetPath);
+/// Merging, with the scripts unpacked under scriptsDir packed back in as the overlay.
+bool buildTranslation(const wchar_t* scriptsDir, const wchar_t* basePath, const wchar_t* targetPath);
+/// With huffman, compressing means huffman-encoding every entry (PAC Variant 2).
+bool packPackage(const wchar_t* sourceDir, const wchar_t* packagePath, bool isBfeFormat,
+		bool compress, bool huffman, u32 threadCount);
 
 #endif
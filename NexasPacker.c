@@ -6,10 +6,12 @@
  * @date		2010.02
  */
 
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <zlib.h>
 #include <wchar.h>
 #include <io.h>
 #include <direct.h>
@@ -18,61 +20,43 @@
 #include "StringUtils.h"
 #include "FileSystem.h"
 #include "LzssCode.h"
-#include "HuffmanCode.h"
+#include "ThreadPool.h"
+#include "Hash64.h"
+#include "PackageWriter.h"
+#include "NexasFormat.h"
 #include "NexasPackage.h"
 
-enum VariantType {
-	CONTENT_NOT_COMPRESSED,
-	CONTENT_LZSS,
-	CONTENT_HUFFMAN,
-	CONTENT_DEFLATE,
-	CONTENT_MAYBE_DEFLATE
-};
-
-struct Header {
-	char typeTag[3];
-	byte magicByte;
-	u32 entryCount;
-	u32 variantTag;
-};
-typedef struct Header Header;
-
-struct IndexEntry {
-	char name[64];
-	u32 offset;
-	u32 decodedLen;
-	u32 encodedLen;
-};
-typedef struct IndexEntry IndexEntry;
+/**
+ * How many entries, counted from the first one not yet written, may be
+ * read and compressed ahead of the writer, per worker.
+ */
+#define PACK_WINDOW_PER_WORKER 4
 
 struct NexasPackage {
 	Header* header;
 	ByteArray* indexes;
 	FILE* file;
+	/// The source files, in the order they go into the package.
+	wchar_t** files;
 };
 typedef struct NexasPackage NexasPackage;
 
-static inline bool shouldZip(wchar_t* filename) {
-	static const wchar_t* targetExts[] = { L".ogg" };
-	for (i8 i = 0; i < 1; ++i) {
-		wchar_t* cmpptr = filename + wcslen(filename) - wcslen(targetExts[i]);
-		if (wcscmp(cmpptr, targetExts[i]) == 0) {
-			return false;
-		}
-	}
-	return true;
-}
-
 static void closePackage(NexasPackage* package) {
 	if (!package) return;
-	if (package->header)
-		free(package->header);
 	if (package->file) {
 		fclose(package->file);
 		package->file = NULL;
 	}
 	if (package->indexes)
 		deleteByteArray(package->indexes);
+	if (package->files) {
+		for (u32 i = 0; i < package->header->entryCount; ++i) {
+			free(package->files[i]);
+		}
+		free(package->files);
+	}
+	if (package->header)
+		free(package->header);
 	free(package);
 	package = NULL;
 }
@@ -80,7 +64,8 @@ static void closePackage(NexasPackage* package) {
 static NexasPackage* openPackage(const wchar_t* packagePath) {
 	NexasPackage* package = malloc(sizeof(NexasPackage));
 	memset(package, 0, sizeof(NexasPackage));
-	if (!(package->file = _wfopen(packagePath, L"wb"))) {
+	/// Opened for reading as well, duplicates are checked against what is written.
+	if (!(package->file = _wfopen(packagePath, L"w+b"))) {
 		writeLog(LOG_QUIET, L"ERROR: Cannot open the package file.");
 		closePackage(package);
 		return NULL;
@@ -89,16 +74,18 @@ static NexasPackage* openPackage(const wchar_t* packagePath) {
 	return package;
 }
 
-static bool determineEntryCountAndWriteHeader(NexasPackage* package, const wchar_t* sourceDir, bool isBfeFormat) {
+static bool determineEntryCountAndWriteHeader(NexasPackage* package, const wchar_t* sourceDir, bool isBfeFormat,
+		bool compress, bool huffman) {
 	writeLog(LOG_VERBOSE, L"Generating package header......");
 	package->header = malloc(sizeof(Header));
 	memcpy(package->header->typeTag, "PAC", 3);
 	package->header->magicByte = 0;
-#if 0
-	package->header->variantTag = isBfeFormat ? CONTENT_LZSS : CONTENT_MAYBE_DEFLATE;
-#else
-	package->header->variantTag = CONTENT_NOT_COMPRESSED;
-#endif
+	if (!compress)
+		package->header->variantTag = CONTENT_NOT_COMPRESSED;
+	else if (isBfeFormat)
+		package->header->variantTag = CONTENT_LZSS;
+	else
+		package->header->variantTag = huffman ? CONTENT_HUFFMAN : CONTENT_MAYBE_DEFLATE;
 	package->header->entryCount = 0;
 
 	writeLog(LOG_VERBOSE, L"Moving into source directory......");
@@ -107,12 +94,19 @@ static bool determineEntryCountAndWriteHeader(NexasPackage* package, const wchar
 		return false;
 	}
 
+	/// The files are listed once, the workers and the writer follow this list.
+	u32 capacity = 0;
 	struct _wfinddata_t foundFile;
 	intptr_t handle = _wfindfirst(L"*", &foundFile);
 	int status = 0;
 	while (status == 0) {
-		if ((foundFile.attrib & _A_SUBDIR) == 0)
-			++(package->header->entryCount);
+		if ((foundFile.attrib & _A_SUBDIR) == 0) {
+			if (package->header->entryCount == capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				package->files = realloc(package->files, sizeof(wchar_t*) * capacity);
+			}
+			package->files[(package->header->entryCount)++] = cloneWCString(foundFile.name);
+		}
 		status = _wfindnext(handle, &foundFile);
 	}
 	_findclose(handle);
@@ -136,11 +130,289 @@ static bool determineEntryCountAndWriteHeader(NexasPackage* package, const wchar
 	return true;
 }
 
-static bool recordAndWriteEntries(NexasPackage* package, bool isBfeFormat) {
-	package->indexes = newByteArray(package->header->entryCount * sizeof(IndexEntry));
+/**
+ * Maps content hashes to entries, the lowest entry index is kept for each
+ * hash. The table is sized for all the entries up front and never grows.
+ */
+struct ContentTable {
+	u64* hashes;
+	/// Entry index + 1, 0 for an empty slot.
+	u32* entries;
+	u32 mask;
+};
+typedef struct ContentTable ContentTable;
+
+static void initContentTable(ContentTable* table, u32 count) {
+	u32 capacity = 16;
+	while (capacity < count * 2) capacity <<= 1;
+	table->hashes = malloc(sizeof(u64) * capacity);
+	table->entries = malloc(sizeof(u32) * capacity);
+	memset(table->entries, 0, sizeof(u32) * capacity);
+	table->mask = capacity - 1;
+}
+
+static void freeContentTable(ContentTable* table) {
+	free(table->hashes);
+	free(table->entries);
+}
+
+static i32 ctFind(const ContentTable* table, u64 hash) {
+	for (u32 slot = (u32)hash & table->mask; table->entries[slot] != 0; slot = (slot + 1) & table->mask) {
+		if (table->hashes[slot] == hash) return table->entries[slot] - 1;
+	}
+	return -1;
+}
+
+/// Returns the entry already there, if it comes before the new one, -1 otherwise.
+static i32 ctRecord(ContentTable* table, u64 hash, u32 entry) {
+	u32 slot = (u32)hash & table->mask;
+	for (; table->entries[slot] != 0; slot = (slot + 1) & table->mask) {
+		if (table->hashes[slot] != hash) continue;
+		u32 existing = table->entries[slot] - 1;
+		if (existing < entry) return existing;
+		table->entries[slot] = entry + 1;
+		return -1;
+	}
+	table->hashes[slot] = hash;
+	table->entries[slot] = entry + 1;
+	return -1;
+}
+
+/**
+ * Entries are read and compressed by a pool of workers, while the calling
+ * thread writes them out strictly in the listed order, assigning offsets
+ * as it goes. So the package comes out the same, whatever the thread count.
+ * A worker does not start an entry too far ahead of the writer, lest the
+ * finished but unwritten entries eat up all the memory.
+ */
+struct PackJob {
+	NexasPackage* package;
+	u32 variantTag;
+	u32 threadCount;
+	/// Variant 1 only, one LZSS encoder for each worker.
+	LzssEncoder** encoders;
+	u32 window;
+	/// The encoded data of each entry, handed from the workers to the writer.
+	ByteArray** results;
+	volatile LONG* ready;
+	volatile LONG written;
+	volatile LONG failed;
+	volatile LONG workersDone;
+	/// What each worker is waiting for (entry index + 1), and how to wake it up.
+	volatile LONG* waiting;
+	HANDLE* wakeups;
+	HANDLE resultReady;
+	/**
+	 * Identical files are stored only once. The workers skip compressing
+	 * a file they find to be the same as an earlier one. The writer checks
+	 * again in order, against what it has written, so which entry owns the
+	 * data does not depend on the timing of the workers.
+	 */
+	u64* hashes;
+	i32* duplicateOf;
+	ContentTable seen;
+	CRITICAL_SECTION seenLock;
+	ContentTable owners;
+	u32 duplicateCount;
+	u64 savedBytes;
+};
+typedef struct PackJob PackJob;
+
+static void wakeWorkers(PackJob* job) {
+	for (u32 w = 0; w < job->threadCount; ++w) {
+		LONG waitingFor = job->waiting[w];
+		if (waitingFor != 0 && (job->failed || (u32)waitingFor - 1 < job->written + job->window))
+			SetEvent(job->wakeups[w]);
+	}
+}
+
+static bool waitForWindow(PackJob* job, u32 workerIndex, u32 i) {
+	InterlockedExchange(&(job->waiting[workerIndex]), i + 1);
+	while (!job->failed && i >= job->written + job->window) {
+		WaitForSingleObject(job->wakeups[workerIndex], INFINITE);
+	}
+	InterlockedExchange(&(job->waiting[workerIndex]), 0);
+	return !job->failed;
+}
+
+static bool compressesAlike(PackJob* job, const wchar_t* name, const wchar_t* other) {
+	return job->variantTag != CONTENT_MAYBE_DEFLATE || pwShouldCompress(name) == pwShouldCompress(other);
+}
+
+/**
+ * Returns NULL if the entry is to be stored as is. Variant 1 has every
+ * entry LZSS-encoded, and Variant 2 huffman-encoded, even when that makes
+ * it larger.
+ */
+static ByteArray* encodeEntry(PackJob* job, u32 workerIndex, u32 i, const ByteArray* original) {
+	if (job->variantTag == CONTENT_LZSS)
+		return lzssEncodeWith(job->encoders[workerIndex], baData(original), baLength(original));
+	if (job->variantTag == CONTENT_HUFFMAN)
+		return pwHuffmanEncode(original, job->package->files[i]);
+	if (job->variantTag == CONTENT_MAYBE_DEFLATE && pwShouldCompress(job->package->files[i]))
+		return pwDeflate(original);
+	return NULL;
+}
+
+/// Compares the file of an earlier entry with the content at hand.
+static bool sameAsEarlier(PackJob* job, u32 i, u32 j, const ByteArray* original) {
+	const wchar_t* name = job->package->files[i];
+	const wchar_t* other = job->package->files[j];
+	if (!compressesAlike(job, name, other)) return false;
+	ByteArray* earlier = pwReadFile(other, j);
+	bool result = earlier != NULL
+			&& baLength(earlier) == baLength(original)
+			&& memcmp(baData(earlier), baData(original), baLength(original)) == 0;
+	deleteByteArray(earlier);
+	return result;
+}
+
+static void findDuplicate(PackJob* job, u32 i, const ByteArray* original) {
+	job->hashes[i] = hash64(baData(original), baLength(original), 0);
+	EnterCriticalSection(&(job->seenLock));
+	i32 earlier = ctRecord(&(job->seen), job->hashes[i], i);
+	LeaveCriticalSection(&(job->seenLock));
+	if (earlier >= 0 && sameAsEarlier(job, i, earlier, original)) {
+		writeLog(LOG_VERBOSE, L"Entry %u is the same as Entry %u.", i, earlier);
+		job->duplicateOf[i] = earlier;
+	}
+}
+
+static bool packEntry(void* context, u32 workerIndex, u32 i) {
+	PackJob* job = context;
+	IndexEntry* indexes = (IndexEntry*)baData(job->package->indexes);
+	const wchar_t* name = job->package->files[i];
+
+	if (!waitForWindow(job, workerIndex, i)) return false;
+
+	ByteArray* original = pwReadFile(name, i);
+	ByteArray* encoded = NULL;
+	if (original != NULL)
+		findDuplicate(job, i, original);
+	if (original != NULL && job->duplicateOf[i] >= 0) {
+		/// Nothing to write, the writer takes the data of the earlier entry.
+		indexes[i].decodedLen = baLength(original);
+		deleteByteArray(original);
+		InterlockedExchange(&(job->ready[i]), 1);
+		SetEvent(job->resultReady);
+		return true;
+	}
+	if (original != NULL) {
+		encoded = encodeEntry(job, workerIndex, i, original);
+		if (encoded != NULL)
+			writeLog(LOG_VERBOSE, L"Entry %u is compressed: ELen: %u", i, baLength(encoded));
+	}
+
+	if (original != NULL) {
+		indexes[i].decodedLen = baLength(original);
+		if (encoded != NULL) {
+			deleteByteArray(original);
+		} else {
+			encoded = original;
+		}
+		indexes[i].encodedLen = baLength(encoded);
+		job->results[i] = encoded;
+		InterlockedExchange(&(job->ready[i]), 1);
+	} else {
+		InterlockedExchange(&(job->failed), 1);
+		wakeWorkers(job);
+	}
+	SetEvent(job->resultReady);
+	return original != NULL;
+}
+
+static unsigned __stdcall runPackWorkers(void* param) {
+	PackJob* job = param;
+	if (!poolRunTasks(job->threadCount, NULL, job->package->header->entryCount, packEntry, job))
+		InterlockedExchange(&(job->failed), 1);
+	InterlockedExchange(&(job->workersDone), 1);
+	SetEvent(job->resultReady);
+	return 0;
+}
+
+static bool waitForResult(PackJob* job, u32 i) {
+	while (!job->ready[i]) {
+		if (job->failed || job->workersDone) return job->ready[i] != 0;
+		WaitForSingleObject(job->resultReady, INFINITE);
+	}
+	return true;
+}
+
+/**
+ * An entry is the same as an earlier one written to the package if the
+ * encoded data is. The same file always compresses to the same bytes.
+ */
+static bool sameAsWritten(PackJob* job, u32 i, u32 j) {
+	IndexEntry* indexes = (IndexEntry*)baData(job->package->indexes);
+	FILE* file = job->package->file;
+	if (indexes[i].decodedLen != indexes[j].decodedLen
+			|| indexes[i].encodedLen != indexes[j].encodedLen)
+		return false;
+
+	ByteArray* written = newByteArray(indexes[j].encodedLen);
+	bool result = _fseeki64(file, indexes[j].offset, SEEK_SET) == 0
+			&& fread(baData(written), 1, indexes[j].encodedLen, file) == indexes[j].encodedLen
+			&& memcmp(baData(written), baData(job->results[i]), indexes[j].encodedLen) == 0;
+	deleteByteArray(written);
+	_fseeki64(file, 0, SEEK_END);
+	return result;
+}
+
+static bool writeEntries(PackJob* job, u32 offset) {
+	IndexEntry* indexes = (IndexEntry*)baData(job->package->indexes);
+	u32 count = job->package->header->entryCount;
+
+	for (u32 i = 0; i < count; ++i) {
+		if (!waitForResult(job, i)) return false;
+		const wchar_t* name = job->package->files[i];
+
+		i32 owner = job->duplicateOf[i];
+		if (owner < 0) {
+			i32 earlier = ctFind(&(job->owners), job->hashes[i]);
+			if (earlier >= 0 && compressesAlike(job, name, job->package->files[earlier])
+					&& sameAsWritten(job, i, earlier))
+				owner = earlier;
+		}
+
+		if (owner >= 0) {
+			indexes[i].offset = indexes[owner].offset;
+			indexes[i].encodedLen = indexes[owner].encodedLen;
+			++(job->duplicateCount);
+			job->savedBytes += indexes[i].encodedLen;
+			writeLog(LOG_VERBOSE, L"Entry %u: %s, Same as Entry %u, Offset: %u",
+					i, name, owner, indexes[i].offset);
+		} else {
+			indexes[i].offset = offset;
+			writeLog(LOG_VERBOSE, L"Entry %u: %s, Offset: %u, OLen: %u, ELen: %u",
+					i, name, indexes[i].offset, indexes[i].decodedLen, indexes[i].encodedLen);
+			if (fwrite(baData(job->results[i]), 1, indexes[i].encodedLen, job->package->file)
+					!= indexes[i].encodedLen) {
+				writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to write to the package!", i, name);
+				return false;
+			}
+			offset += indexes[i].encodedLen;
+			ctRecord(&(job->owners), job->hashes[i], i);
+		}
+		if (job->results[i]) {
+			deleteByteArray(job->results[i]);
+			job->results[i] = NULL;
+		}
+
+		InterlockedExchange(&(job->written), i + 1);
+		wakeWorkers(job);
+		writeLog(LOG_NORMAL, L"Packed: Entry %u: %s.", i, name);
+	}
+	if (job->duplicateCount > 0)
+		writeLog(LOG_NORMAL, L"%u duplicate entries share their data, %llu bytes saved.",
+				job->duplicateCount, job->savedBytes);
+	return true;
+}
+
+static bool recordAndWriteEntries(NexasPackage* package, bool isBfeFormat, u32 threadCount) {
+	u32 count = package->header->entryCount;
+	package->indexes = newByteArray(count * sizeof(IndexEntry));
 	IndexEntry* indexes = (IndexEntry*)baData(package->indexes);
 
-	u32 i = 0;
 	u32 offset = 12;
 
 	if (isBfeFormat) {
@@ -156,139 +428,111 @@ static bool recordAndWriteEntries(NexasPackage* package, bool isBfeFormat) {
 		offset += len;
 	}
 
-	struct _wfinddata_t foundFile;
-	intptr_t handle = _wfindfirst(L"*", &foundFile);
-	int status = 0;
-	while (status == 0) {
-		if ((foundFile.attrib & _A_SUBDIR) == 0) {
-			char* fname = toMBString(foundFile.name, L"japanese");
-			if (strlen(fname) >= 64) {
-				writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, The file name is too long!", i, foundFile.name);
-				free(fname);
-				return false;
-			}
-			strncpy(indexes[i].name, fname, 64);
+	/// The names are converted here, before the workers are started.
+	for (u32 i = 0; i < count; ++i) {
+		char* fname = toMBString(package->files[i], CODE_PAGE_SHIFT_JIS);
+		if (fname == NULL) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, The file name cannot be represented in Shift-JIS!",
+					i, package->files[i]);
+			return false;
+		}
+		if (strlen(fname) >= 64) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, The file name is too long!", i, package->files[i]);
 			free(fname);
-
-			indexes[i].encodedLen = foundFile.size;
-			indexes[i].decodedLen = foundFile.size;
-			indexes[i].offset = offset;
-			writeLog(LOG_VERBOSE, L"Entry %u: %s, Offset: %u, OLen: %u",
-					i, foundFile.name, indexes[i].offset, indexes[i].decodedLen);
-
-			FILE* infile = _wfopen(foundFile.name, L"rb");
-			byte* decodedData = malloc(indexes[i].decodedLen);
-
-			if (fread(decodedData, 1, indexes[i].decodedLen, infile) != indexes[i].decodedLen) {
-				writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to read the file!", i, foundFile.name);
-				free(decodedData);
-				fclose(infile);
-				return false;
-			}
-			fclose(infile);
-
-			byte* encodedData = NULL;
-			ByteArray* encodedArray = NULL;
-
-#if 0
-			if (isBfeFormat) {
-				encodedArray = lzssEncode(decodedData, indexes[i].decodedLen);
-				encodedData = baData(encodedArray);
-				indexes[i].encodedLen = baLength(encodedArray);
-			} else if (shouldZip(foundFile.name)) {
-				encodedData = malloc(indexes[i].decodedLen);
-				unsigned long len = indexes[i].encodedLen;
-				if (compress(encodedData, &len, decodedData, indexes[i].decodedLen) != Z_OK) {
-					free(encodedData);
-					free(decodedData);
-					return false;
-				}
-				indexes[i].encodedLen = len;
-				writeLog(LOG_VERBOSE, L"Entry %u is compressed: ELen: %u", i, len);
-			}
-			else
-#endif
-			{
-				encodedData = decodedData;
-			}
-			offset += indexes[i].encodedLen;
-			writeLog(LOG_VERBOSE, L"Entry %u: ELen: %u", i, indexes[i].encodedLen);
-
-			if (fwrite(encodedData, 1, indexes[i].encodedLen, package->file) != indexes[i].encodedLen) {
-				writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to write to the package!", i, foundFile.name);
-				if (encodedArray != NULL) {
-					deleteByteArray(encodedArray);
-				} else if (encodedData != decodedData) {
-					free(encodedData);
-				}
-				free(decodedData);
-				return false;
-			}
-
-			if (encodedArray != NULL) {
-				deleteByteArray(encodedArray);
-			} else if (encodedData != decodedData) {
-				free(encodedData);
-			}
-			free(decodedData);
-
-			writeLog(LOG_NORMAL, L"Packed: Entry %u: %s.", i, foundFile.name);
-			++i;
+			return false;
 		}
-		status = _wfindnext(handle, &foundFile);
+		strncpy(indexes[i].name, fname, 64);
+		free(fname);
 	}
-	_findclose(handle);
-	return true;
-}
 
-static bool writeBfeIndex(NexasPackage* package) {
-	writeLog(LOG_VERBOSE, L"Writing plain text index.");
-	fseek(package->file, 12, SEEK_SET);
-	if (fwrite(baData(package->indexes), 1, baLength(package->indexes), package->file) != baLength(package->indexes)) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write the indexes to the package!");
-		return false;
+	PackJob job;
+	memset(&job, 0, sizeof(PackJob));
+	job.package = package;
+	job.variantTag = package->header->variantTag;
+	job.threadCount = threadCount < count ? threadCount : count;
+	if (job.variantTag == CONTENT_LZSS) {
+		job.encoders = malloc(sizeof(LzssEncoder*) * job.threadCount);
+		for (u32 w = 0; w < job.threadCount; ++w) {
+			job.encoders[w] = pwNewLzssEncoder();
+		}
 	}
-	writeLog(LOG_VERBOSE, L"Written plain text index, length is: %u.", baLength(package->indexes));
-	return true;
-}
-
-static bool writeIndexes(NexasPackage* package, bool isBfeFormat) {
-	if (isBfeFormat)
-		return writeBfeIndex(package);
-	ByteArray* encodedIndexes =
-			huffmanEncode(L"Entry Indexes", baData(package->indexes), baLength(package->indexes));
-	if (encodedIndexes == NULL) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to encode the indexes!");
-		return false;
+	job.window = job.threadCount * PACK_WINDOW_PER_WORKER;
+	job.results = malloc(sizeof(ByteArray*) * count);
+	memset(job.results, 0, sizeof(ByteArray*) * count);
+	job.ready = malloc(sizeof(LONG) * count);
+	memset((void*)job.ready, 0, sizeof(LONG) * count);
+	job.waiting = malloc(sizeof(LONG) * job.threadCount);
+	memset((void*)job.waiting, 0, sizeof(LONG) * job.threadCount);
+	job.wakeups = malloc(sizeof(HANDLE) * job.threadCount);
+	for (u32 w = 0; w < job.threadCount; ++w) {
+		job.wakeups[w] = CreateEventW(NULL, FALSE, FALSE, NULL);
 	}
-
-	byte* encodedData = baData(encodedIndexes);
-	u32 encodedLen = baLength(encodedIndexes);
-	writeLog(LOG_VERBOSE, L"The length of the compressed index is %u.", encodedLen);
-	/// Important: XOR encryption!
-	for (u32 i = 0; i < encodedLen; ++i) {
-		encodedData[i] ^= 0xFF;
+	job.resultReady = CreateEventW(NULL, FALSE, FALSE, NULL);
+	job.hashes = malloc(sizeof(u64) * count);
+	job.duplicateOf = malloc(sizeof(i32) * count);
+	for (u32 i = 0; i < count; ++i) {
+		job.duplicateOf[i] = -1;
 	}
-
-	if (fwrite(encodedData, 1, encodedLen, package->file) != baLength(encodedIndexes)) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write the indexes to the package!");
-		return false;
+	initContentTable(&(job.seen), count);
+	initContentTable(&(job.owners), count);
+	InitializeCriticalSection(&(job.seenLock));
+
+	writeLog(LOG_VERBOSE, L"Packing %u entries with %u threads.", count, job.threadCount);
+	bool result = false;
+	HANDLE workers = (HANDLE)_beginthreadex(NULL, 0, runPackWorkers, &job, 0, NULL);
+	if (workers == 0) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to start the workers!");
+	} else {
+		result = writeEntries(&job, offset);
+		if (!result) {
+			/// Let the waiting workers know there is no point going on.
+			InterlockedExchange(&(job.failed), 1);
+			wakeWorkers(&job);
+		}
+		WaitForSingleObject(workers, INFINITE);
+		CloseHandle(workers);
 	}
 
-	if (fwrite(&encodedLen, 4, 1, package->file) != 1) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write the index length to the package!");
-		return false;
+	for (u32 i = 0; i < count; ++i) {
+		if (job.results[i]) deleteByteArray(job.results[i]);
 	}
-	return true;
+	for (u32 w = 0; w < job.threadCount; ++w) {
+		CloseHandle(job.wakeups[w]);
+	}
+	CloseHandle(job.resultReady);
+	if (job.encoders) {
+		for (u32 w = 0; w < job.threadCount; ++w) {
+			deleteLzssEncoder(job.encoders[w]);
+		}
+		free(job.encoders);
+	}
+	DeleteCriticalSection(&(job.seenLock));
+	freeContentTable(&(job.owners));
+	freeContentTable(&(job.seen));
+	free(job.duplicateOf);
+	free(job.hashes);
+	free(job.wakeups);
+	free((void*)job.waiting);
+	free((void*)job.ready);
+	free(job.results);
+	return result;
+}
+
+static bool writeIndexes(NexasPackage* package, bool isBfeFormat) {
+	if (!isBfeFormat)
+		return pwWriteEncodedIndex(package->file, package->indexes);
+	fseek(package->file, 12, SEEK_SET);
+	return pwWritePlainIndex(package->file, package->indexes);
 }
 
-bool packPackage(const wchar_t* sourceDir, const wchar_t* packagePath, bool isBfeFormat) {
+bool packPackage(const wchar_t* sourceDir, const wchar_t* packagePath, bool isBfeFormat,
+		bool compress, bool huffman, u32 threadCount) {
 	writeLog(LOG_NORMAL, L"Packing files under directory: %s", sourceDir);
 	writeLog(LOG_NORMAL, L"To package: %s", packagePath);
 	NexasPackage* package = openPackage(packagePath);
 	if (!package) return false;
-	bool result = determineEntryCountAndWriteHeader(package, sourceDir, isBfeFormat)
-			&& recordAndWriteEntries(package, isBfeFormat)
+	bool result = determineEntryCountAndWriteHeader(package, sourceDir, isBfeFormat, compress, huffman)
+			&& recordAndWriteEntries(package, isBfeFormat, threadCount)
 			&& writeIndexes(package, isBfeFormat);
 	closePackage(package);
 	writeLog(LOG_NORMAL, (result) ? L"Packing Successful." : L"ERROR: Packing Failed.");
@@ -0,0 +1,613 @@
+/**
+ * @file		NexasPatcher.c
+ * @brief		Updating a few entries of a package, in place or into a
+ * 				new package, without encoding the others again.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+/**
+ * A package (except for PAC Variant 1) is laid out as:
+ *
+ * Header | entry data ... | encoded index | index length
+ *
+ * Patching writes the new or changed entries over the encoded index, right
+ * after the existing data, then writes a new index after them. Entries
+ * that did not change stay where they are. The data of replaced entries
+ * is left behind as dead space, until the package is compacted.
+ *
+ * Merging writes a new package instead, copying the encoded data of the
+ * untouched entries as is, so only the overlay files are encoded.
+ * Compacting is merging with an empty overlay. Building a translation is
+ * merging with scripts put together in memory from their unpacked parts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <io.h>
+#include <direct.h>
+#include <sys/stat.h>
+
+#include "Logger.h"
+#include "StringUtils.h"
+#include "LzssCode.h"
+#include "PacReader.h"
+#include "PackageWriter.h"
+#include "ScriptFile.h"
+#include "NexasPackage.h"
+
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+struct PatchItem {
+	wchar_t* name;
+	u32 index;
+	/// For build-translation, the unpacked script the entry is put together from.
+	wchar_t* scriptDir;
+};
+typedef struct PatchItem PatchItem;
+
+/**
+ * What patching needs to know about the package, read before it is
+ * opened for writing. The old tail is kept so it can be put back if
+ * anything goes wrong.
+ */
+struct PatchJob {
+	Header header;
+	ByteArray* indexes;
+	u32 oldEntryCount;
+	u32 entryCount;
+	u64 dataEnd;
+	u64 length;
+	ByteArray* oldTail;
+	PatchItem* items;
+	u32 itemCount;
+};
+typedef struct PatchJob PatchJob;
+
+static void cleanupPatchJob(PatchJob* job) {
+	if (job->indexes) deleteByteArray(job->indexes);
+	if (job->oldTail) deleteByteArray(job->oldTail);
+	for (u32 i = 0; i < job->itemCount; ++i) {
+		free(job->items[i].name);
+		free(job->items[i].scriptDir);
+	}
+	if (job->items) free(job->items);
+}
+
+static bool readPackageTail(PatchJob* job, PacReader* reader) {
+	if (prHasPlainIndex(reader)) {
+		writeLog(LOG_QUIET, L"ERROR: PAC Variant 1 packages cannot be patched, please use pack-bfe.");
+		return false;
+	}
+
+	FILE* file = prFile(reader);
+	if (file) {
+		_fseeki64(file, 0, SEEK_END);
+		job->length = _ftelli64(file);
+	} else {
+		job->length = mfLength(prMappedFile(reader));
+	}
+
+	u32 encodedLen = 0;
+	if (job->length < 16 || !prReadAt(reader, file, job->length - 4, sizeof(u32), &encodedLen)
+			|| job->length - 4 - 12 < encodedLen) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to locate the compressed index!");
+		return false;
+	}
+	job->dataEnd = job->length - 4 - encodedLen;
+	job->oldTail = newByteArray(encodedLen + 4);
+	if (!prReadAt(reader, file, job->dataEnd, encodedLen + 4, baData(job->oldTail))) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the compressed index!");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Finds out which entry an overlay item replaces. Names are matched
+ * ignoring case, as Windows file names are, and a replaced entry keeps
+ * its own spelling in the index. An item not in the package becomes a
+ * new entry, its name has to fit in the index.
+ */
+static bool addPatchItem(PatchJob* job, PacReader* reader, const wchar_t* name, const wchar_t* scriptDir,
+		u32* capacity, u32* newCount) {
+	char* fname = toMBString(name, CODE_PAGE_SHIFT_JIS);
+	bool result = false;
+	if (fname == NULL) {
+		writeLog(LOG_QUIET, L"ERROR: %s, The file name cannot be represented in Shift-JIS!", name);
+	} else if (strlen(fname) >= 64) {
+		writeLog(LOG_QUIET, L"ERROR: %s, The file name is too long!", name);
+	} else {
+		i32 index = prFindEntry(reader, name);
+		/// A script has no file of its own, so it goes by the name of its entry.
+		const wchar_t* entryName = (index >= 0 && scriptDir) ? prEntryName(reader, index) : NULL;
+		if (index < 0)
+			index = job->entryCount + (*newCount)++;
+		if (job->itemCount == *capacity) {
+			*capacity = *capacity ? *capacity * 2 : 64;
+			job->items = realloc(job->items, sizeof(PatchItem) * *capacity);
+		}
+		job->items[job->itemCount].name = cloneWCString(entryName ? entryName : name);
+		job->items[job->itemCount].index = index;
+		job->items[job->itemCount].scriptDir = scriptDir ? cloneWCString(scriptDir) : NULL;
+		++(job->itemCount);
+		result = true;
+	}
+	free(fname);
+	return result;
+}
+
+/// Grows the index for the new entries, and names them.
+static void addNewEntries(PatchJob* job, u32 newCount) {
+	ByteArray* indexes = newByteArray((job->entryCount + newCount) * sizeof(IndexEntry));
+	memcpy(baData(indexes), baData(job->indexes), job->entryCount * sizeof(IndexEntry));
+	deleteByteArray(job->indexes);
+	job->indexes = indexes;
+	IndexEntry* entries = (IndexEntry*)baData(indexes);
+	for (u32 i = 0; i < job->itemCount; ++i) {
+		if (job->items[i].index >= job->entryCount) {
+			char* fname = toMBString(job->items[i].name, CODE_PAGE_SHIFT_JIS);
+			strncpy(entries[job->items[i].index].name, fname, 64);
+			free(fname);
+		}
+	}
+	job->entryCount += newCount;
+}
+
+/**
+ * Lists the overlay directory, and finds out which entries each file
+ * replaces. Files not in the package are added as new entries.
+ */
+static bool matchOverlay(PatchJob* job, PacReader* reader, const wchar_t* overlayDir) {
+	if (_wchdir(overlayDir) != 0) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the overlay directory!");
+		return false;
+	}
+
+	u32 capacity = 0;
+	u32 newCount = 0;
+	bool result = true;
+	struct _wfinddata_t foundFile;
+	intptr_t handle = _wfindfirst(L"*", &foundFile);
+	int status = (handle == -1) ? -1 : 0;
+	while (status == 0 && result) {
+		if ((foundFile.attrib & _A_SUBDIR) == 0)
+			result = addPatchItem(job, reader, foundFile.name, NULL, &capacity, &newCount);
+		status = _wfindnext(handle, &foundFile);
+	}
+	if (handle != -1) _findclose(handle);
+	if (!result) return false;
+
+	addNewEntries(job, newCount);
+	writeLog(LOG_NORMAL, L"%u files in the overlay, %u of them are new entries.",
+			job->itemCount, newCount);
+	return true;
+}
+
+/**
+ * Lists the unpacked scripts under the scripts directory, as unpack-scripts
+ * leaves them: the script 'name.bin' in the subdirectory 'name', holding
+ * head.bin, script.txt and tail.bin. Other subdirectories are passed over.
+ * unpack-scripts takes '.BIN' as well, so the entry is matched ignoring case.
+ */
+static bool matchScripts(PatchJob* job, PacReader* reader, const wchar_t* scriptsDir) {
+	if (_wchdir(scriptsDir) != 0) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the scripts directory!");
+		return false;
+	}
+
+	u32 capacity = 0;
+	u32 newCount = 0;
+	bool result = true;
+	struct _wfinddata_t foundFile;
+	intptr_t handle = _wfindfirst(L"*", &foundFile);
+	int status = (handle == -1) ? -1 : 0;
+	while (status == 0 && result) {
+		if ((foundFile.attrib & _A_SUBDIR) != 0
+				&& wcscmp(foundFile.name, L".") != 0 && wcscmp(foundFile.name, L"..") != 0) {
+			wchar_t* textPath = wcsAppend(foundFile.name, L"\\script.txt");
+			struct _stat64 st;
+			if (_wstat64(textPath, &st) == 0) {
+				wchar_t* name = wcsAppend(foundFile.name, L".bin");
+				result = addPatchItem(job, reader, name, foundFile.name, &capacity, &newCount);
+				free(name);
+			} else {
+				writeLog(LOG_VERBOSE, L"%s has no script.txt, passed over.", foundFile.name);
+			}
+			free(textPath);
+		}
+		status = _wfindnext(handle, &foundFile);
+	}
+	if (handle != -1) _findclose(handle);
+	if (!result) return false;
+
+	addNewEntries(job, newCount);
+	writeLog(LOG_NORMAL, L"%u scripts to build, %u of them are new entries.",
+			job->itemCount, newCount);
+	return true;
+}
+
+/// The header and a copy of the index, to be changed and written anew.
+static bool copyIndex(PatchJob* job, PacReader* reader) {
+	job->entryCount = prEntryCount(reader);
+	job->oldEntryCount = job->entryCount;
+	job->indexes = newByteArray(job->entryCount * sizeof(IndexEntry));
+	memcpy(baData(job->indexes), prEntries(reader), job->entryCount * sizeof(IndexEntry));
+	return prReadAt(reader, prFile(reader), 0, sizeof(Header), &(job->header));
+}
+
+static bool loadPatchJob(PatchJob* job, const wchar_t* packagePath, const wchar_t* overlayDir) {
+	PacReader* reader = openPacReader(packagePath, false);
+	if (!reader) return false;
+
+	u32 vtag = prVariant(reader);
+	bool result = true;
+	if (vtag != CONTENT_MAYBE_DEFLATE && vtag != CONTENT_HUFFMAN && vtag != CONTENT_NOT_COMPRESSED) {
+		writeLog(LOG_QUIET, L"ERROR: This PAC variant cannot be patched.");
+		result = false;
+	}
+	if (result) {
+		result = copyIndex(job, reader)
+				&& readPackageTail(job, reader)
+				&& matchOverlay(job, reader, overlayDir);
+	}
+	/// The package has to be closed (and unmapped) before it can be written.
+	closePacReader(reader);
+	return result;
+}
+
+/**
+ * Reads an overlay file, encodes it the way the package wants, writes it
+ * at the current position and fills in its index entry.
+ */
+static bool writeOverlayFile(const PatchItem* item, u32 variantTag, FILE* file, u64 offset, IndexEntry* entry) {
+	ByteArray* original = item->scriptDir ? buildScript(item->scriptDir) : pwReadFile(item->name, item->index);
+	if (original == NULL) {
+		if (item->scriptDir)
+			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to build the script!", item->index, item->name);
+		return false;
+	}
+	ByteArray* encoded = NULL;
+	if (variantTag == CONTENT_MAYBE_DEFLATE && pwShouldCompress(item->name))
+		encoded = pwDeflate(original);
+	else if (variantTag == CONTENT_LZSS) {
+		LzssEncoder* encoder = pwNewLzssEncoder();
+		encoded = lzssEncodeWith(encoder, baData(original), baLength(original));
+		deleteLzssEncoder(encoder);
+	} else if (variantTag == CONTENT_HUFFMAN)
+		encoded = pwHuffmanEncode(original, item->name);
+	const ByteArray* data = encoded ? encoded : original;
+
+	bool result = false;
+	if (offset + baLength(data) > 0xFFFFFFFFULL) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, The package would be too large!", item->index, item->name);
+	} else if (fwrite(baData(data), 1, baLength(data), file) != baLength(data)) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to write to the package!", item->index, item->name);
+	} else {
+		entry->offset = (u32)offset;
+		entry->decodedLen = baLength(original);
+		entry->encodedLen = baLength(data);
+		result = true;
+	}
+	deleteByteArray(encoded);
+	deleteByteArray(original);
+	return result;
+}
+
+static bool writePatchedEntries(PatchJob* job, FILE* file) {
+	IndexEntry* entries = (IndexEntry*)baData(job->indexes);
+	u64 offset = job->dataEnd;
+	_fseeki64(file, offset, SEEK_SET);
+
+	for (u32 i = 0; i < job->itemCount; ++i) {
+		u32 index = job->items[i].index;
+		if (!writeOverlayFile(&(job->items[i]), job->header.variantTag, file, offset, &(entries[index])))
+			return false;
+		offset += entries[index].encodedLen;
+		writeLog(LOG_NORMAL, L"Patched: Entry %u: %s.", index, job->items[i].name);
+	}
+	return true;
+}
+
+static bool truncatePackage(FILE* file, u64 length) {
+	return fflush(file) == 0 && _chsize_s(_fileno(file), length) == 0;
+}
+
+static bool applyPatch(PatchJob* job, const wchar_t* packagePath) {
+	FILE* file = _wfopen(packagePath, L"r+b");
+	if (!file) {
+		writeLog(LOG_QUIET, L"ERROR: Cannot open the package file for writing.");
+		return false;
+	}
+
+	job->header.entryCount = job->entryCount;
+	bool result = writePatchedEntries(job, file)
+			&& pwWriteEncodedIndex(file, job->indexes);
+	if (result) {
+		/// Only the header knows the new entry count.
+		u64 end = _ftelli64(file);
+		result = _fseeki64(file, 0, SEEK_SET) == 0
+				&& fwrite(&(job->header), sizeof(Header), 1, file) == 1
+				&& truncatePackage(file, end);
+		if (result)
+			writeLog(LOG_VERBOSE, L"Package length: %llu -> %llu.", job->length, end);
+	}
+
+	if (!result) {
+		/// Put the old index back, so the package is just as it was.
+		writeLog(LOG_QUIET, L"ERROR: Restoring the original index.");
+		job->header.entryCount = job->oldEntryCount;
+		if (_fseeki64(file, 0, SEEK_SET) != 0
+				|| fwrite(&(job->header), sizeof(Header), 1, file) != 1
+				|| _fseeki64(file, job->dataEnd, SEEK_SET) != 0
+				|| fwrite(baData(job->oldTail), 1, baLength(job->oldTail), file) != baLength(job->oldTail)
+				|| !truncatePackage(file, job->length)) {
+			writeLog(LOG_QUIET, L"ERROR: Unable to restore the package, it is now damaged!");
+		}
+	}
+	fclose(file);
+	return result;
+}
+
+bool patchPackage(const wchar_t* packagePath, const wchar_t* overlayDir) {
+	writeLog(LOG_NORMAL, L"Patching package: %s", packagePath);
+	writeLog(LOG_NORMAL, L"With files under directory: %s", overlayDir);
+
+	PatchJob job;
+	memset(&job, 0, sizeof(PatchJob));
+	bool result = loadPatchJob(&job, packagePath, overlayDir)
+			&& applyPatch(&job, packagePath);
+	cleanupPatchJob(&job);
+	writeLog(LOG_NORMAL, (result) ? L"Patching Successful." : L"ERROR: Patching Failed.");
+	return result;
+}
+
+/**
+ * Untouched entries sharing the very same data are copied only once, and
+ * go on sharing it in the new package.
+ */
+struct CompactItem {
+	u32 index;
+	u32 offset;
+	u32 encodedLen;
+};
+typedef struct CompactItem CompactItem;
+
+static int compareByData(const void* a, const void* b) {
+	const CompactItem* x = a;
+	const CompactItem* y = b;
+	if (x->offset != y->offset) return (x->offset > y->offset) - (x->offset < y->offset);
+	if (x->encodedLen != y->encodedLen) return (x->encodedLen > y->encodedLen) - (x->encodedLen < y->encodedLen);
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+/// For each untouched entry, the first untouched entry with the same data.
+static u32* findSharedData(const IndexEntry* entries, u32 count, const PatchItem* const* overlay) {
+	CompactItem* items = malloc(sizeof(CompactItem) * count);
+	u32 itemCount = 0;
+	for (u32 i = 0; i < count; ++i) {
+		if (overlay[i] != NULL) continue;
+		items[itemCount].index = i;
+		items[itemCount].offset = entries[i].offset;
+		items[itemCount].encodedLen = entries[i].encodedLen;
+		++itemCount;
+	}
+	qsort(items, itemCount, sizeof(CompactItem), compareByData);
+
+	u32* owners = malloc(sizeof(u32) * count);
+	u32 owner = 0;
+	for (u32 i = 0; i < itemCount; ++i) {
+		/// The sort puts the lowest index first among the sharers.
+		if (i == 0 || items[i - 1].offset != items[i].offset
+				|| items[i - 1].encodedLen != items[i].encodedLen)
+			owner = items[i].index;
+		owners[items[i].index] = owner;
+	}
+	free(items);
+	return owners;
+}
+
+/**
+ * A run of untouched entries lying back to back in the base package is
+ * copied in one go, straight from the mapping if there is one.
+ */
+struct RawSpan {
+	u64 offset;
+	u64 length;
+};
+typedef struct RawSpan RawSpan;
+
+static bool copySpan(PacReader* reader, RawSpan* span, FILE* target, byte* buffer) {
+	const MappedFile* map = prMappedFile(reader);
+	bool result = true;
+	if (span->length == 0) return true;
+	if (map) {
+		result = mfContains(map, span->offset, span->length)
+				&& fwrite(mfData(map) + span->offset, 1, span->length, target) == span->length;
+		if (result) mfDontNeed(map, span->offset, span->length);
+	} else {
+		u64 offset = span->offset;
+		u64 remaining = span->length;
+		while (remaining > 0 && result) {
+			u32 len = remaining < COPY_BUFFER_SIZE ? (u32)remaining : COPY_BUFFER_SIZE;
+			result = prReadAt(reader, prFile(reader), offset, len, buffer)
+					&& fwrite(buffer, 1, len, target) == len;
+			offset += len;
+			remaining -= len;
+		}
+	}
+	if (!result)
+		writeLog(LOG_QUIET, L"ERROR: Unable to copy the entries from the base package!");
+	span->length = 0;
+	return result;
+}
+
+/**
+ * Writes a new package: the entries of the base package in index order,
+ * with the encoded data of the untouched ones copied as is, and the
+ * overlay files encoded anew. Files new to the package come last.
+ */
+static bool writeMerged(PatchJob* job, PacReader* reader, const wchar_t* tempPath, u64* newLength) {
+	bool plainIndex = prHasPlainIndex(reader);
+	IndexEntry* entries = (IndexEntry*)baData(job->indexes);
+	const IndexEntry* baseEntries = prEntries(reader);
+
+	if (plainIndex && job->entryCount != job->oldEntryCount) {
+		writeLog(LOG_QUIET, L"ERROR: New entries cannot be added to a Baldr Force EXE package, please use pack-bfe.");
+		return false;
+	}
+
+	FILE* target = _wfopen(tempPath, L"wb");
+	if (!target) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to create the new package!");
+		return false;
+	}
+
+	const PatchItem** overlay = malloc(sizeof(PatchItem*) * job->entryCount);
+	memset(overlay, 0, sizeof(PatchItem*) * job->entryCount);
+	for (u32 i = 0; i < job->itemCount; ++i) {
+		overlay[job->items[i].index] = &(job->items[i]);
+	}
+
+	job->header.entryCount = job->entryCount;
+	bool result = fwrite(&(job->header), sizeof(Header), 1, target) == 1;
+	/// PAC Variant 1 has its index right here, fill it in later.
+	if (result && plainIndex)
+		result = pwWritePlainIndex(target, job->indexes);
+
+	u32* owners = findSharedData(baseEntries, job->oldEntryCount, overlay);
+	byte* buffer = prMappedFile(reader) ? NULL : malloc(COPY_BUFFER_SIZE);
+	RawSpan span = { 0, 0 };
+	u64 offset = 12 + (plainIndex ? baLength(job->indexes) : 0);
+	u32 copied = 0;
+	for (u32 i = 0; i < job->entryCount && result; ++i) {
+		if (overlay[i] != NULL) {
+			result = copySpan(reader, &span, target, buffer)
+					&& writeOverlayFile(overlay[i], job->header.variantTag, target, offset, &(entries[i]));
+			if (result) {
+				offset += entries[i].encodedLen;
+				writeLog(LOG_NORMAL, L"Replaced: Entry %u: %s.", i, overlay[i]->name);
+			}
+			continue;
+		}
+		if (owners[i] != i) {
+			entries[i].offset = entries[owners[i]].offset;
+			continue;
+		}
+		if (offset + baseEntries[i].encodedLen > 0xFFFFFFFFULL) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u, The package would be too large!", i);
+			result = false;
+			break;
+		}
+		if (span.offset + span.length != baseEntries[i].offset)
+			result = copySpan(reader, &span, target, buffer);
+		if (span.length == 0)
+			span.offset = baseEntries[i].offset;
+		span.length += baseEntries[i].encodedLen;
+		entries[i].offset = (u32)offset;
+		offset += entries[i].encodedLen;
+		++copied;
+	}
+	if (result)
+		result = copySpan(reader, &span, target, buffer);
+	if (buffer) free(buffer);
+	free(owners);
+	free(overlay);
+
+	if (result) {
+		writeLog(LOG_VERBOSE, L"%u entries copied as is.", copied);
+		if (plainIndex) {
+			result = _fseeki64(target, 12, SEEK_SET) == 0 && pwWritePlainIndex(target, job->indexes);
+			_fseeki64(target, 0, SEEK_END);
+		} else {
+			result = pwWriteEncodedIndex(target, job->indexes);
+		}
+	}
+	*newLength = _ftelli64(target);
+	if (fclose(target) != 0) result = false;
+	if (!result) _wremove(tempPath);
+	return result;
+}
+
+/**
+ * The new package is written next to the target first, so the base
+ * package itself can be the target.
+ */
+static bool rebuildPackage(const wchar_t* basePath, const wchar_t* overlayDir, bool scripts,
+		const wchar_t* targetPath, u64* oldLength, u64* newLength) {
+	PacReader* reader = openPacReader(basePath, false);
+	if (!reader) return false;
+
+	PatchJob job;
+	memset(&job, 0, sizeof(PatchJob));
+	FILE* file = prFile(reader);
+	if (file) {
+		_fseeki64(file, 0, SEEK_END);
+		*oldLength = _ftelli64(file);
+	} else {
+		*oldLength = mfLength(prMappedFile(reader));
+	}
+
+	wchar_t* tempPath = wcsAppend(targetPath, L".tmp");
+	bool result = copyIndex(&job, reader)
+			&& (overlayDir == NULL
+				|| (scripts ? matchScripts(&job, reader, overlayDir) : matchOverlay(&job, reader, overlayDir)))
+			&& writeMerged(&job, reader, tempPath, newLength);
+	closePacReader(reader);
+
+	if (result) {
+		_wremove(targetPath);
+		if (_wrename(tempPath, targetPath) != 0) {
+			writeLog(LOG_QUIET, L"ERROR: Unable to replace the target package, the new one is at %s.", tempPath);
+			result = false;
+		}
+	}
+	free(tempPath);
+	cleanupPatchJob(&job);
+	return result;
+}
+
+bool mergePackage(const wchar_t* basePath, const wchar_t* overlayDir, const wchar_t* targetPath) {
+	writeLog(LOG_NORMAL, L"Merging package: %s", basePath);
+	writeLog(LOG_NORMAL, L"With files under directory: %s", overlayDir);
+	writeLog(LOG_NORMAL, L"To package: %s", targetPath);
+	u64 oldLength = 0;
+	u64 newLength = 0;
+	bool result = rebuildPackage(basePath, overlayDir, false, targetPath, &oldLength, &newLength);
+	if (result)
+		writeLog(LOG_VERBOSE, L"Package length: %llu -> %llu.", oldLength, newLength);
+	writeLog(LOG_NORMAL, (result) ? L"Merging Successful." : L"ERROR: Merging Failed.");
+	return result;
+}
+
+/**
+ * The scripts never touch the disk as .bin files, each one is built in
+ * memory and encoded right into the new package.
+ */
+bool buildTranslation(const wchar_t* scriptsDir, const wchar_t* basePath, const wchar_t* targetPath) {
+	writeLog(LOG_NORMAL, L"Building translation from scripts under: %s", scriptsDir);
+	writeLog(LOG_NORMAL, L"Into package: %s", basePath);
+	writeLog(LOG_NORMAL, L"To package: %s", targetPath);
+	u64 oldLength = 0;
+	u64 newLength = 0;
+	bool result = rebuildPackage(basePath, scriptsDir, true, targetPath, &oldLength, &newLength);
+	if (result)
+		writeLog(LOG_VERBOSE, L"Package length: %llu -> %llu.", oldLength, newLength);
+	writeLog(LOG_NORMAL, (result) ? L"Building Successful." : L"ERROR: Building Failed.");
+	return result;
+}
+
+/// Compacting is merging with nothing, back into the same package.
+bool compactPackage(const wchar_t* packagePath) {
+	writeLog(LOG_NORMAL, L"Compacting package: %s", packagePath);
+	u64 oldLength = 0;
+	u64 newLength = 0;
+	bool result = rebuildPackage(packagePath, NULL, false, packagePath, &oldLength, &newLength);
+	if (result)
+		writeLog(LOG_NORMAL, L"Reclaimed %lld bytes.", (i64)oldLength - (i64)newLength);
+	writeLog(LOG_NORMAL, (result) ? L"Compacting Successful." : L"ERROR: Compacting Failed.");
+	return result;
+}
@@ -10,254 +10,529 @@
 #include <stdio.h>
 #include <string.h>
 #include <zlib.h>
+#include <io.h>
+#include <fcntl.h>
 
 #include "Logger.h"
 #include "StringUtils.h"
 #include "FileSystem.h"
+#include "ThreadPool.h"
+#include "PacReader.h"
 #include "LzssCode.h"
-#include "HuffmanCode.h"
+#include "CodecContext.h"
 #include "NexasPackage.h"
 
-enum VariantType {
-	CONTENT_NOT_COMPRESSED,
-	CONTENT_LZSS,
-	CONTENT_HUFFMAN,
-	CONTENT_DEFLATE,
-	CONTENT_MAYBE_DEFLATE
-};
+/**
+ * Entries larger than this are decoded piece by piece through windows of
+ * STREAM_WINDOW bytes, instead of being decoded as a whole in memory.
+ */
+#define STREAM_THRESHOLD (4 * 1024 * 1024)
+#define STREAM_WINDOW (256 * 1024)
 
-struct Header {
-	char typeTag[3];
-	byte magicByte;
-	u32 entryCount;
-	u32 variantTag;
-};
-typedef struct Header Header;
+static bool indexCacheEnabled = false;
 
-struct IndexEntry {
-	char name[64];
-	u32 offset;
-	u32 decodedLen;
-	u32 encodedLen;
+void useIndexCache(bool enabled) {
+	indexCacheEnabled = enabled;
+}
+
+/**
+ * Everything the extraction workers share. When the package is mapped the
+ * workers read from the mapping directly, otherwise each one streams big
+ * entries through its own file handle, so no one has to wait for others' seeks.
+ */
+struct ExtractJob {
+	PacReader* reader;
+	const wchar_t* packagePath;
+	const wchar_t* targetDir;
+	const wchar_t** names;
+	FILE** files;
+	/// The decoders and buffers of each worker, reused for all its entries.
+	CodecContext** codecs;
+	/// When set, entries are written here instead of to files under targetDir.
+	FILE* output;
 };
-typedef struct IndexEntry IndexEntry;
+typedef struct ExtractJob ExtractJob;
 
-struct NexasPackage {
-	Header* header;
-	ByteArray* indexes;
-	FILE* file;
+struct OrderItem {
+	u32 index;
+	u32 size;
+	bool superseded;
+	const wchar_t* name;
 };
-typedef struct NexasPackage NexasPackage;
-
-static void closePackage(NexasPackage* package) {
-	if (!package) return;
-	if (package->header)
-		free(package->header);
-	if (package->file) {
-		fclose(package->file);
-		package->file = NULL;
-	}
-	if (package->indexes)
-		deleteByteArray(package->indexes);
-	free(package);
-	package = NULL;
+typedef struct OrderItem OrderItem;
+
+static int compareByName(const void* a, const void* b) {
+	const OrderItem* x = a;
+	const OrderItem* y = b;
+	/// Windows file names are case insensitive.
+	int result = _wcsicmp(x->name, y->name);
+	if (result != 0) return result;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compareBySizeDescending(const void* a, const void* b) {
+	const OrderItem* x = a;
+	const OrderItem* y = b;
+	if (x->size != y->size) return (x->size < y->size) - (x->size > y->size);
+	return (x->index > y->index) - (x->index < y->index);
 }
 
-static NexasPackage* openPackage(const wchar_t* packagePath) {
-	NexasPackage* package = malloc(sizeof(NexasPackage));
-	memset(package, 0, sizeof(NexasPackage));
+/**
+ * The biggest entries are extracted first, so a few huge voice or BGM
+ * files will not be left running alone at the end.
+ * When several entries share one name, the last one wins in a serial
+ * extraction, so we drop the others here to get the very same output.
+ */
+static u32* buildExtractionOrder(ExtractJob* job, u32* orderCount) {
+	const IndexEntry* indexes = prEntries(job->reader);
+	u32 count = prEntryCount(job->reader);
+	OrderItem* items = malloc(sizeof(OrderItem) * count);
 
-	if (!(package->file = _wfopen(packagePath, L"rb"))) {
-		writeLog(LOG_QUIET, L"ERROR: Cannot open the package file.");
-		closePackage(package);
-		return NULL;
+	/// An entry whose name could not be converted is left out.
+	u32 itemCount = 0;
+	for (u32 i = 0; i < count; ++i) {
+		if (job->names[i] == NULL) continue;
+		items[itemCount].index = i;
+		items[itemCount].size = indexes[i].decodedLen;
+		items[itemCount].superseded = false;
+		items[itemCount].name = job->names[i];
+		++itemCount;
 	}
-	writeLog(LOG_VERBOSE, L"Package Opened.");
-	return package;
-}
+	count = itemCount;
 
-static bool validateHeader(NexasPackage* package) {
-	package->header = malloc(sizeof(Header));
-	if (fread(package->header, sizeof(Header), 1, package->file) != 1) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read the package header.");
-		return false;
+	qsort(items, count, sizeof(OrderItem), compareByName);
+	for (u32 i = 0; i + 1 < count; ++i) {
+		if (_wcsicmp(items[i].name, items[i + 1].name) == 0) {
+			writeLog(LOG_VERBOSE, L"Entry %u: %s, Superseded by Entry %u.",
+					items[i].index, items[i].name, items[i + 1].index);
+			items[i].superseded = true;
+		}
 	}
+	qsort(items, count, sizeof(OrderItem), compareBySizeDescending);
 
-	/**
-	 *  The typeTag is not null-terminated, so we cannot use strcmp here.
-	 */
-	if (memcmp(package->header->typeTag, "PAC", 3) != 0) {
-		writeLog(LOG_QUIET, L"ERROR: Target file is not a valid package.");
-		return false;
+	u32* order = malloc(sizeof(u32) * count);
+	*orderCount = 0;
+	for (u32 i = 0; i < count; ++i) {
+		if (!items[i].superseded)
+			order[(*orderCount)++] = items[i].index;
 	}
+	free(items);
+	return order;
+}
 
-	u32 vtag = package->header->variantTag;
-	writeLog(LOG_VERBOSE, L"File variant tag is %d.", vtag);
+static FILE* openOutput(ExtractJob* job, u32 i, wchar_t** wPath) {
+	*wPath = NULL;
+	if (job->output) return job->output;
 
-	if (vtag != CONTENT_MAYBE_DEFLATE && vtag != CONTENT_LZSS && vtag != CONTENT_NOT_COMPRESSED) {
-		writeLog(LOG_QUIET, L"ERROR: This PAC variant is not supported yet.");
-		return false;
+	*wPath = fsCombinePath(job->targetDir, job->names[i]);
+	FILE* outFile = _wfopen(*wPath, L"wb");
+	if (outFile == NULL) {
+		writeLog(LOG_QUIET,
+				L"ERROR: Entry %u: %s, Unable to open output file!",
+					i, job->names[i]);
 	}
-	writeLog(LOG_NORMAL, L"Entry count: %u.", package->header->entryCount);
-	return true;
+	return outFile;
 }
 
-static bool decodeIndex(NexasPackage* package) {
-	fseek(package->file, -4, SEEK_END);
-	u32 encodedLen;
-	if (fread(&encodedLen, sizeof(u32), 1, package->file) != 1) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read the length of the encoded index!");
-		return false;
+static void closeOutput(ExtractJob* job, FILE* outFile) {
+	if (outFile == job->output)
+		fflush(outFile);
+	else
+		fclose(outFile);
+}
+
+static CodecContext* workerCodec(ExtractJob* job, u32 workerIndex) {
+	if (job->codecs[workerIndex] == NULL)
+		job->codecs[workerIndex] = newCodecContext();
+	return job->codecs[workerIndex];
+}
+
+static FILE* workerFile(ExtractJob* job, u32 workerIndex, u32 i) {
+	if (job->files[workerIndex] == NULL
+			&& !(job->files[workerIndex] = _wfopen(job->packagePath, L"rb"))) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to open the package file!",
+				i, job->names[i]);
 	}
-	writeLog(LOG_VERBOSE, L"The length of the compressed index is %d.", encodedLen);
+	return job->files[workerIndex];
+}
+
+/**
+ * A stored entry of a mapped package is written straight from the mapping,
+ * the others are decoded into the worker's buffer first.
+ */
+static bool decodeEntry(ExtractJob* job, u32 workerIndex, u32 i) {
+	const IndexEntry* indexes = prEntries(job->reader);
+	const MappedFile* map = prMappedFile(job->reader);
+	const wchar_t* wName = job->names[i];
 
-	if (fseek(package->file, -4-encodedLen, SEEK_END) != 0) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to locate the compressed index!");
+	const byte* decoded = prReadEntryWith(job->reader, workerCodec(job, workerIndex), i);
+	if (decoded == NULL) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to extract data!", i, wName);
 		return false;
 	}
 
-	ByteArray* encodedData = newByteArray(encodedLen);
-	byte* data = baData(encodedData);
-	if (fread(data, sizeof(byte), encodedLen, package->file) != encodedLen) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read the compressed index!");
-		deleteByteArray(encodedData);
-		return false;
+	wchar_t* wPath = NULL;
+	FILE* outFile = openOutput(job, i, &wPath);
+	bool result = outFile != NULL;
+	if (result && fwrite(decoded, 1, indexes[i].decodedLen, outFile)
+			!= indexes[i].decodedLen) {
+		writeLog(LOG_QUIET,
+				L"ERROR: Entry %u: %s, Unable to write file content!",
+					i, wName);
+		result = false;
 	}
+	if (outFile) closeOutput(job, outFile);
+	if (map)
+		mfDontNeed(map, indexes[i].offset, indexes[i].encodedLen);
+	if (wPath) free(wPath);
+	return result;
+}
 
-	for (u32 i = 0; i < encodedLen; ++i) {
-		data[i] ^= 0xFF;
+/**
+ * Hands out the encoded data of an entry one window at a time, either
+ * straight from the mapping or read through the worker's file handle.
+ */
+struct EntryStream {
+	ExtractJob* job;
+	FILE* file;
+	u64 offset;
+	u32 remaining;
+	u32 consumed;
+	byte* buffer;
+};
+typedef struct EntryStream EntryStream;
+
+static bool nextChunk(EntryStream* stream, const byte** chunk, u32* length) {
+	const MappedFile* map = prMappedFile(stream->job->reader);
+	u32 len = stream->remaining < STREAM_WINDOW ? stream->remaining : STREAM_WINDOW;
+
+	if (map) {
+		/// Let go of the window we are done with, and ask for the next one.
+		if (stream->consumed > 0)
+			mfDontNeed(map, stream->offset - stream->consumed, stream->consumed);
+		mfWillNeed(map, stream->offset + len, stream->remaining - len < STREAM_WINDOW
+				? stream->remaining - len : STREAM_WINDOW);
+		*chunk = mfData(map) + stream->offset;
+	} else {
+		if (fread(stream->buffer, 1, len, stream->file) != len) return false;
+		*chunk = stream->buffer;
 	}
+	stream->offset += len;
+	stream->remaining -= len;
+	stream->consumed = len;
+	*length = len;
+	return true;
+}
 
-	u32 decodedLen = sizeof(IndexEntry) * package->header->entryCount;
-	ByteArray* originalIndexes =
-			huffmanDecode(L"Entry Indexes", data, encodedLen, decodedLen);
-	deleteByteArray(encodedData);
-	package->indexes = originalIndexes;
-	return (package->indexes != NULL);
+static bool inflateChunks(EntryStream* stream, FILE* outFile, z_stream* zs, byte* window, u32 decodedLen) {
+	if (zs == NULL) return false;
+
+	u32 written = 0;
+	int status = Z_OK;
+	while (status != Z_STREAM_END && stream->remaining > 0) {
+		const byte* chunk = NULL;
+		u32 length = 0;
+		if (!nextChunk(stream, &chunk, &length)) break;
+		zs->next_in = (Bytef*)chunk;
+		zs->avail_in = length;
+
+		do {
+			zs->next_out = window;
+			zs->avail_out = STREAM_WINDOW;
+			status = inflate(zs, Z_NO_FLUSH);
+			/// Z_BUF_ERROR only means no progress could be made this round.
+			if (status == Z_BUF_ERROR) status = Z_OK;
+			if (status != Z_OK && status != Z_STREAM_END) return false;
+			u32 produced = STREAM_WINDOW - zs->avail_out;
+			if (fwrite(window, 1, produced, outFile) != produced) return false;
+			written += produced;
+		} while (zs->avail_out == 0 && status != Z_STREAM_END);
+	}
+	return status == Z_STREAM_END && written == decodedLen;
 }
 
-static bool readIndex(NexasPackage* package) {
-	/// First, try to read plain text index (used in Baldr Force EXE, PAC variant 2).
-	writeLog(LOG_VERBOSE, L"Trying to read the index as plain text.");
-	u32 indexesLen = package->header->entryCount * sizeof(IndexEntry);
-	fseek(package->file, 12, SEEK_SET);
-	package->indexes = newByteArray(indexesLen);
-	if (fread(baData(package->indexes), sizeof(byte), indexesLen, package->file) != indexesLen) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read the 'plain text' index!");
-		deleteByteArray(package->indexes);
-		return false;
+/// The LZSS entries of Variant 1, the ring is all the decoder keeps.
+static bool unlzssChunks(EntryStream* stream, FILE* outFile, LzssDecoder* decoder, byte* window, u32 decodedLen) {
+	lzssDecoderInit(decoder, decodedLen);
+
+	bool result = true;
+	bool complete = false;
+	while (result && !complete && stream->remaining > 0) {
+		const byte* chunk = NULL;
+		u32 length = 0;
+		if (!nextChunk(stream, &chunk, &length)) {
+			result = false;
+			break;
+		}
+		while (length > 0) {
+			u32 consumed = 0;
+			u32 produced = lzssDecoderFeed(decoder, chunk, length, &consumed, window, STREAM_WINDOW);
+			if (fwrite(window, 1, produced, outFile) != produced) {
+				result = false;
+				break;
+			}
+			/// Nothing taken and nothing given, the entry is all there.
+			if (consumed == 0 && produced == 0) {
+				complete = true;
+				break;
+			}
+			chunk += consumed;
+			length -= consumed;
+		}
 	}
 
-	/**
-	 * If the index data is valid, the packed file contents should be immediately following,
-	 * or we can conclude that the real index data is at the end of the file and encoded.
-	 */
-	IndexEntry* indexes = (IndexEntry*)(baData(package->indexes));
-	if (indexes[0].offset != 12 + indexesLen) {
-		writeLog(LOG_VERBOSE, L"The index is invalid, trying to read encoded index.");
-		return decodeIndex(package);
+	u32 produced;
+	while (result && (produced = lzssDecoderFinish(decoder, window, STREAM_WINDOW)) > 0) {
+		if (fwrite(window, 1, produced, outFile) != produced) result = false;
 	}
-	return true;
+	return result;
 }
 
-static void cleanupForEntry(wchar_t* name, wchar_t* path, ByteArray* encodedData, ByteArray* decodedData, bool success) {
-	if (name) free(name);
-	if (path) free(path);
-	if (encodedData != NULL && encodedData != decodedData)
-		deleteByteArray(encodedData);
-	if (decodedData != NULL)
-		deleteByteArray(decodedData);
+static bool copyChunks(EntryStream* stream, FILE* outFile) {
+	while (stream->remaining > 0) {
+		const byte* chunk = NULL;
+		u32 length = 0;
+		if (!nextChunk(stream, &chunk, &length)) return false;
+		if (fwrite(chunk, 1, length, outFile) != length) return false;
+	}
+	return true;
 }
 
-static bool extractFiles(NexasPackage* package, const wchar_t* targetDir) {
-	IndexEntry* indexes = (IndexEntry*)baData(package->indexes);
-	u32 count = package->header->entryCount;
+/**
+ * Used for big entries, so memory usage stays at a few windows per worker
+ * no matter how big the entry is.
+ */
+static bool streamEntry(ExtractJob* job, u32 workerIndex, u32 i) {
+	const IndexEntry* indexes = prEntries(job->reader);
+	const MappedFile* map = prMappedFile(job->reader);
+	const wchar_t* wName = job->names[i];
 
-	for (u32 i = 0; i < count; ++i) {
-		wchar_t* wName = toWCString(indexes[i].name, L"japanese");
-		writeLog(LOG_VERBOSE, L"Entry %u: %s, Offset: %u, ELen: %u, DLen: %u",
-				i, wName, indexes[i].offset, indexes[i].encodedLen,
-				indexes[i].decodedLen);
-		if (fseek(package->file, indexes[i].offset, SEEK_SET) != 0) {
+	EntryStream stream;
+	memset(&stream, 0, sizeof(EntryStream));
+	stream.job = job;
+	stream.offset = indexes[i].offset;
+	stream.remaining = indexes[i].encodedLen;
+
+	if (map) {
+		if (!mfContains(map, indexes[i].offset, indexes[i].encodedLen)) {
 			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to locate data!",
-													i, wName);
-			cleanupForEntry(wName, NULL, NULL, NULL, false);
+					i, wName);
 			return false;
 		}
-
-		ByteArray* encodedData = newByteArray(indexes[i].encodedLen);
-		ByteArray* decodedData = encodedData;
-		if (fread(baData(encodedData), 1, indexes[i].encodedLen, package->file) != indexes[i].encodedLen) {
-			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to read data from package!",
-							i, wName);
-			cleanupForEntry(wName, NULL, encodedData, NULL, false);
+	} else {
+		if ((stream.file = workerFile(job, workerIndex, i)) == NULL) return false;
+		if (_fseeki64(stream.file, stream.offset, SEEK_SET) != 0) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to locate data!",
+					i, wName);
 			return false;
 		}
+	}
 
-		/**
-		 * Now we support two PAC variants.
-		 * The first is Variant 4, where contents are either uncompressed (like ogg files),
-		 * or compressed using zlib (the deflate algorithm).
-		 * We should do a test to determine if the particular file is compressed or not.
-		 */
-		if (package->header->variantTag == CONTENT_MAYBE_DEFLATE) {
-			unsigned long decodedLen = indexes[i].decodedLen;
-			if (decodedLen > indexes[i].encodedLen) {
-				decodedData = newByteArray(decodedLen);
-				if (uncompress(baData(decodedData), &decodedLen, baData(encodedData), indexes[i].encodedLen) != Z_OK) {
-					writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to extract data!", i, wName);
-					cleanupForEntry(wName, NULL, encodedData, decodedData, false);
-					return false;
-				}
-			}
-		} else if (package->header->variantTag == CONTENT_LZSS) {
-			decodedData = lzssDecode(baData(encodedData), indexes[i].encodedLen, indexes[i].decodedLen);
-			if (decodedData == NULL) {
-				writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to extract data!", i, wName);
-				cleanupForEntry(wName, NULL, encodedData, decodedData, false);
-				return false;
-			}
+	wchar_t* wPath = NULL;
+	FILE* outFile = openOutput(job, i, &wPath);
+	if (outFile == NULL) {
+		if (wPath) free(wPath);
+		return false;
+	}
+
+	CodecContext* codec = workerCodec(job, workerIndex);
+	stream.buffer = map ? NULL : ccInputBuffer(codec, STREAM_WINDOW);
+	bool result;
+	if (!map && stream.buffer == NULL) {
+		result = false;
+	} else if (prVariant(job->reader) == CONTENT_LZSS) {
+		byte* window = ccOutputBuffer(codec, STREAM_WINDOW);
+		result = window && unlzssChunks(&stream, outFile, ccLzssDecoder(codec), window, indexes[i].decodedLen);
+	} else if (!prIsStored(job->reader, i)) {
+		byte* window = ccOutputBuffer(codec, STREAM_WINDOW);
+		result = window && inflateChunks(&stream, outFile, ccInflater(codec), window, indexes[i].decodedLen);
+	} else {
+		result = copyChunks(&stream, outFile);
+	}
+	if (map && stream.consumed > 0)
+		mfDontNeed(map, stream.offset - stream.consumed, stream.consumed);
+	closeOutput(job, outFile);
+
+	if (!result) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to extract data!", i, wName);
+		/// Do not leave a truncated file behind.
+		if (wPath) _wremove(wPath);
+	}
+	if (wPath) free(wPath);
+	return result;
+}
+
+static bool extractEntry(void* context, u32 workerIndex, u32 i) {
+	ExtractJob* job = context;
+	const IndexEntry* indexes = prEntries(job->reader);
+	u32 vtag = prVariant(job->reader);
+
+	writeLog(LOG_VERBOSE, L"Entry %u: %s, Offset: %u, ELen: %u, DLen: %u",
+			i, job->names[i], indexes[i].offset, indexes[i].encodedLen,
+			indexes[i].decodedLen);
+
+	bool shouldStream = (vtag == CONTENT_MAYBE_DEFLATE || vtag == CONTENT_NOT_COMPRESSED || vtag == CONTENT_LZSS)
+			&& (indexes[i].decodedLen >= STREAM_THRESHOLD || indexes[i].encodedLen >= STREAM_THRESHOLD);
+
+	bool result = shouldStream
+			? streamEntry(job, workerIndex, i)
+			: decodeEntry(job, workerIndex, i);
+	if (result)
+		writeLog(LOG_NORMAL, L"Unpacked: Entry %u: %s", i, job->names[i]);
+	return result;
+}
+
+/**
+ * The reader's own file handle is left alone, prReadEntry() may be using it
+ * on another worker at the same time.
+ */
+static void initJob(ExtractJob* job, PacReader* reader, const wchar_t* packagePath, const wchar_t* targetDir, u32 threadCount) {
+	memset(job, 0, sizeof(ExtractJob));
+	job->reader = reader;
+	job->packagePath = packagePath;
+	job->targetDir = targetDir;
+	job->files = malloc(sizeof(FILE*) * threadCount);
+	memset(job->files, 0, sizeof(FILE*) * threadCount);
+	job->codecs = malloc(sizeof(CodecContext*) * threadCount);
+	memset(job->codecs, 0, sizeof(CodecContext*) * threadCount);
+	job->names = malloc(sizeof(wchar_t*) * prEntryCount(reader));
+	memset(job->names, 0, sizeof(wchar_t*) * prEntryCount(reader));
+}
+
+static void finishJob(ExtractJob* job, u32 threadCount) {
+	for (u32 i = 0; i < threadCount; ++i) {
+		if (job->files[i]) fclose(job->files[i]);
+		deleteCodecContext(job->codecs[i]);
+	}
+	free(job->names);
+	free(job->codecs);
+	free(job->files);
+}
+
+static bool extractFiles(PacReader* reader, const wchar_t* packagePath, const wchar_t* targetDir, u32 threadCount) {
+	u32 count = prEntryCount(reader);
+
+	ExtractJob job;
+	initJob(&job, reader, packagePath, targetDir, threadCount);
+	u32 badNameCount = 0;
+	for (u32 i = 0; i < count; ++i) {
+		job.names[i] = prEntryName(reader, i);
+		if (job.names[i] == NULL) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u, Unable to convert the name, skipped!", i);
+			++badNameCount;
 		}
+	}
 
-		wchar_t* wPath = fsCombinePath(targetDir, wName);
-		FILE* outFile = _wfopen(wPath, L"wb");
-		if (outFile == NULL) {
-			writeLog(LOG_QUIET,
-					L"ERROR: Entry %u: %s, Unable to open output file!",
-						i, wName);
-			cleanupForEntry(wName, wPath, encodedData, decodedData, false);
-			return false;
+	u32 orderCount = 0;
+	u32* order = buildExtractionOrder(&job, &orderCount);
+	writeLog(LOG_VERBOSE, L"Extracting %u entries with %u threads.", orderCount, threadCount);
+
+	bool result = poolRunTasks(threadCount, order, orderCount, extractEntry, &job);
+	if (badNameCount > 0) result = false;
+
+	finishJob(&job, threadCount);
+	free(order);
+	return result;
+}
+
+/**
+ * Looks the requested names up in a hash table built over the index,
+ * then extracts only those entries. Each entry is extracted once, even
+ * if it is asked for more than once.
+ */
+static bool extractSelected(PacReader* reader, const wchar_t* packagePath,
+		const wchar_t* const* names, u32 nameCount, const wchar_t* targetDir, FILE* output, u32 threadCount) {
+	ExtractJob job;
+	initJob(&job, reader, packagePath, targetDir, threadCount);
+	job.output = output;
+
+	u32* order = malloc(sizeof(u32) * nameCount);
+	u32 orderCount = 0;
+	bool result = true;
+	for (u32 i = 0; i < nameCount; ++i) {
+		i32 index = prFindEntry(reader, names[i]);
+		if (index < 0) {
+			writeLog(LOG_QUIET, L"ERROR: %s, No such entry in the package!", names[i]);
+			result = false;
+			break;
 		}
-		if (fwrite(baData(decodedData), 1, indexes[i].decodedLen, outFile)
-				!= indexes[i].decodedLen) {
-			writeLog(LOG_QUIET,
-					L"ERROR: Entry %u: %s, Unable to write file content!",
-						i, wName);
-			cleanupForEntry(wName, wPath, encodedData, decodedData, false);
-			fclose(outFile);
-			return false;
+		if (job.names[index] != NULL) continue;
+		job.names[index] = prEntryName(reader, index);
+		if (job.names[index] == NULL) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u, Unable to convert the name!", index);
+			result = false;
+			break;
 		}
-		fclose(outFile);
-		writeLog(LOG_NORMAL, L"Unpacked: Entry %u: %s", i, wName);
-		cleanupForEntry(wName, wPath, encodedData, decodedData, true);
+		order[orderCount++] = index;
 	}
 
-	return true;
+	/// Writing to a single stream must not be interleaved.
+	if (result)
+		result = poolRunTasks(output ? 1 : threadCount, order, orderCount, extractEntry, &job);
+
+	finishJob(&job, threadCount);
+	free(order);
+	return result;
 }
 
-bool unpackPackage(const wchar_t* packagePath, const wchar_t* targetDir) {
+bool unpackPackage(const wchar_t* packagePath, const wchar_t* targetDir, u32 threadCount) {
 	writeLog(LOG_NORMAL, L"Unpacking package: %s", packagePath);
 	writeLog(LOG_NORMAL, L"To Directory: %s", targetDir);
 	if (!fsEnsureDirectoryExists(targetDir)) {
 		writeLog(LOG_QUIET, L"ERROR: Target directory does not exist and cannot be created.", targetDir);
 		return false;
 	}
-	NexasPackage* package = openPackage(packagePath);
-	if (!package) return false;
-	bool result = validateHeader(package)
-			&& readIndex(package)
-			&& extractFiles(package, targetDir);
-	closePackage(package);
+	PacReader* reader = openPacReader(packagePath, indexCacheEnabled);
+	bool result = reader != NULL
+			&& extractFiles(reader, packagePath, targetDir, threadCount);
+	closePacReader(reader);
 	writeLog(LOG_NORMAL, (result) ? L"Unpacking Successful." : L"ERROR: Unpacking Failed.");
 	return result;
 }
+
+bool extractEntries(const wchar_t* packagePath, const wchar_t* const* names, u32 nameCount,
+		const wchar_t* targetDir, u32 threadCount) {
+	writeLog(LOG_NORMAL, L"Extracting %u entries from package: %s", nameCount, packagePath);
+	writeLog(LOG_NORMAL, L"To Directory: %s", targetDir);
+	PacReader* reader = openPacReader(packagePath, indexCacheEnabled);
+	bool result = reader != NULL
+			&& extractSelected(reader, packagePath, names, nameCount, targetDir, NULL, threadCount);
+	closePacReader(reader);
+	writeLog(LOG_NORMAL, (result) ? L"Extraction Successful." : L"ERROR: Extraction Failed.");
+	return result;
+}
+
+bool catEntry(const wchar_t* packagePath, const wchar_t* name) {
+	writeLog(LOG_VERBOSE, L"Writing %s from package %s to stdout.", name, packagePath);
+	PacReader* reader = openPacReader(packagePath, indexCacheEnabled);
+	if (!reader) return false;
+	/// The entry is binary data, so no newline translation please.
+	_setmode(_fileno(stdout), _O_BINARY);
+	bool result = extractSelected(reader, packagePath, &name, 1, NULL, stdout, 1);
+	closePacReader(reader);
+	if (!result) writeLog(LOG_QUIET, L"ERROR: Unable to write the entry to stdout.");
+	return result;
+}
+
+bool listPackage(const wchar_t* packagePath) {
+	writeLog(LOG_VERBOSE, L"Listing package: %s", packagePath);
+	PacReader* reader = openPacReader(packagePath, indexCacheEnabled);
+	if (!reader) return false;
+
+	/**
+	 * One entry per line: name, original length and packed length,
+	 * separated by tabs. The names are in UTF-8, for other tools to read.
+	 */
+	_setmode(_fileno(stdout), _O_BINARY);
+	bool result = true;
+	for (u32 i = 0; i < prEntryCount(reader) && result; ++i) {
+		const IndexEntry* entry = &(prEntries(reader)[i]);
+		const char* name = prEntryUTF8Name(reader, i);
+		result = fprintf(stdout, "%s\t%u\t%u\n", name ? name : "",
+				entry->decodedLen, entry->encodedLen) > 0;
+	}
+	fflush(stdout);
+	closePacReader(reader);
+	if (!result) writeLog(LOG_QUIET, L"ERROR: Unable to write the list to stdout.");
+	return result;
+}
@@ -0,0 +1,401 @@
+/**
+ * @file		PacReader.c
+ * @brief		Read access to the entries of a PAC file, for embedding
+ * 				into other programs (libzbspac).
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "Logger.h"
+#include "StringUtils.h"
+#include "LzssCode.h"
+#include "HuffmanCode.h"
+#include "CodecContext.h"
+#include "NameTable.h"
+#include "IndexCache.h"
+#include "PacReader.h"
+
+/**
+ * The entries come either from the decoded index, or from the index cache.
+ * The names are converted on demand, unless the cache has them.
+ * When the package cannot be mapped, reads through the file handle are
+ * serialized with the lock.
+ */
+struct PacReader {
+	Header* header;
+	ByteArray* indexes;
+	FILE* file;
+	MappedFile* map;
+	u64 length;
+	IndexCache* cache;
+	const IndexEntry* entries;
+	wchar_t** names;
+	char** utf8Names;
+	NameTable* table;
+	CRITICAL_SECTION lock;
+};
+
+static void freeNames(void** names, u32 count) {
+	if (!names) return;
+	for (u32 i = 0; i < count; ++i) {
+		if (names[i]) free(names[i]);
+	}
+	free(names);
+}
+
+void closePacReader(PacReader* reader) {
+	if (!reader) return;
+	if (reader->file)
+		fclose(reader->file);
+	if (reader->map)
+		closeMappedFile(reader->map);
+	if (reader->indexes)
+		deleteByteArray(reader->indexes);
+	if (reader->header) {
+		freeNames((void**)reader->names, reader->header->entryCount);
+		freeNames((void**)reader->utf8Names, reader->header->entryCount);
+	}
+	if (reader->table)
+		deleteNameTable(reader->table);
+	if (reader->cache)
+		closeIndexCache(reader->cache);
+	if (reader->header)
+		free(reader->header);
+	DeleteCriticalSection(&(reader->lock));
+	free(reader);
+}
+
+static PacReader* openPackage(const wchar_t* packagePath) {
+	PacReader* reader = malloc(sizeof(PacReader));
+	memset(reader, 0, sizeof(PacReader));
+	InitializeCriticalSection(&(reader->lock));
+
+	/**
+	 * Map the whole package if possible, so the entries can be decoded
+	 * straight from the mapping. A 32-bit process may not have enough
+	 * address space for the biggest packages, then we fall back to reading
+	 * the file the old way.
+	 */
+	if ((reader->map = openMappedFile(packagePath)) != NULL) {
+		reader->length = mfLength(reader->map);
+		writeLog(LOG_VERBOSE, L"Package Opened and mapped.");
+		return reader;
+	}
+
+	if (!(reader->file = _wfopen(packagePath, L"rb"))) {
+		writeLog(LOG_QUIET, L"ERROR: Cannot open the package file.");
+		closePacReader(reader);
+		return NULL;
+	}
+	_fseeki64(reader->file, 0, SEEK_END);
+	reader->length = _ftelli64(reader->file);
+	writeLog(LOG_VERBOSE, L"Package Opened.");
+	return reader;
+}
+
+bool prReadAt(const PacReader* reader, FILE* file, u64 offset, u32 length, void* buffer) {
+	if (reader->map) {
+		if (!mfContains(reader->map, offset, length)) return false;
+		memcpy(buffer, mfData(reader->map) + offset, length);
+		return true;
+	}
+	if (_fseeki64(file, offset, SEEK_SET) != 0) return false;
+	return fread(buffer, 1, length, file) == length;
+}
+
+static bool validateHeader(PacReader* reader) {
+	reader->header = malloc(sizeof(Header));
+	if (!prReadAt(reader, reader->file, 0, sizeof(Header), reader->header)) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the package header.");
+		return false;
+	}
+
+	/**
+	 *  The typeTag is not null-terminated, so we cannot use strcmp here.
+	 */
+	if (memcmp(reader->header->typeTag, "PAC", 3) != 0) {
+		writeLog(LOG_QUIET, L"ERROR: Target file is not a valid package.");
+		return false;
+	}
+
+	u32 vtag = reader->header->variantTag;
+	writeLog(LOG_VERBOSE, L"File variant tag is %d.", vtag);
+
+	if (vtag != CONTENT_MAYBE_DEFLATE && vtag != CONTENT_LZSS && vtag != CONTENT_HUFFMAN
+			&& vtag != CONTENT_NOT_COMPRESSED) {
+		writeLog(LOG_QUIET, L"ERROR: This PAC variant is not supported yet.");
+		return false;
+	}
+	writeLog(LOG_NORMAL, L"Entry count: %u.", reader->header->entryCount);
+	return true;
+}
+
+static bool decodeIndex(PacReader* reader) {
+	u32 encodedLen;
+	if (reader->length < 4
+			|| !prReadAt(reader, reader->file, reader->length - 4, sizeof(u32), &encodedLen)) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the length of the encoded index!");
+		return false;
+	}
+	writeLog(LOG_VERBOSE, L"The length of the compressed index is %d.", encodedLen);
+
+	if (reader->length - 4 < encodedLen) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to locate the compressed index!");
+		return false;
+	}
+
+	ByteArray* encodedData = newByteArray(encodedLen);
+	byte* data = baData(encodedData);
+	if (!prReadAt(reader, reader->file, reader->length - 4 - encodedLen, encodedLen, data)) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the compressed index!");
+		deleteByteArray(encodedData);
+		return false;
+	}
+
+	for (u32 i = 0; i < encodedLen; ++i) {
+		data[i] ^= 0xFF;
+	}
+
+	u32 decodedLen = sizeof(IndexEntry) * reader->header->entryCount;
+	ByteArray* originalIndexes =
+			huffmanDecode(L"Entry Indexes", data, encodedLen, decodedLen);
+	deleteByteArray(encodedData);
+	reader->indexes = originalIndexes;
+	return (reader->indexes != NULL);
+}
+
+static bool readIndex(PacReader* reader) {
+	/// First, try to read plain text index (used in Baldr Force EXE, PAC variant 2).
+	writeLog(LOG_VERBOSE, L"Trying to read the index as plain text.");
+	u32 indexesLen = reader->header->entryCount * sizeof(IndexEntry);
+
+	if (!prHasPlainIndex(reader)) {
+		writeLog(LOG_VERBOSE, L"The index is invalid, trying to read encoded index.");
+		return decodeIndex(reader);
+	}
+
+	reader->indexes = newByteArray(indexesLen);
+	if (!prReadAt(reader, reader->file, 12, indexesLen, baData(reader->indexes))) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the 'plain text' index!");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * If the index data is valid, the packed file contents should be immediately following,
+ * or we can conclude that the real index data is at the end of the file and encoded.
+ * Only the first entry is needed to tell.
+ */
+bool prHasPlainIndex(PacReader* reader) {
+	u32 indexesLen = reader->header->entryCount * sizeof(IndexEntry);
+	IndexEntry first;
+	EnterCriticalSection(&(reader->lock));
+	bool result = reader->header->entryCount > 0
+			&& prReadAt(reader, reader->file, 12, sizeof(IndexEntry), &first)
+			&& first.offset == 12 + indexesLen;
+	LeaveCriticalSection(&(reader->lock));
+	return result;
+}
+
+/**
+ * With useCache, a valid cache spares us the index decoding.
+ * Otherwise the index is decoded as usual, and a new cache is written.
+ */
+PacReader* openPacReader(const wchar_t* packagePath, bool useCache) {
+	PacReader* reader = openPackage(packagePath);
+	if (!reader) return NULL;
+	if (!validateHeader(reader)) {
+		closePacReader(reader);
+		return NULL;
+	}
+
+	PackageStamp stamp;
+	bool stamped = useCache && stampPackage(packagePath, &stamp);
+	if (stamped && (reader->cache = openIndexCache(packagePath, reader->header, &stamp)) != NULL) {
+		reader->entries = icEntries(reader->cache);
+		return reader;
+	}
+
+	if (!readIndex(reader)) {
+		closePacReader(reader);
+		return NULL;
+	}
+	reader->entries = (const IndexEntry*)baData(reader->indexes);
+
+	if (stamped) {
+		for (u32 i = 0; i < reader->header->entryCount; ++i) {
+			prEntryName(reader, i);
+		}
+		saveIndexCache(packagePath, reader->header, &stamp,
+				reader->entries, (const wchar_t* const*)reader->names);
+	}
+	return reader;
+}
+
+u32 prEntryCount(const PacReader* reader) {
+	return reader->header->entryCount;
+}
+
+u32 prVariant(const PacReader* reader) {
+	return reader->header->variantTag;
+}
+
+const IndexEntry* prEntries(const PacReader* reader) {
+	return reader->entries;
+}
+
+const MappedFile* prMappedFile(const PacReader* reader) {
+	return reader->map;
+}
+
+FILE* prFile(const PacReader* reader) {
+	return reader->file;
+}
+
+static void** allocNames(u32 count) {
+	void** names = malloc(sizeof(void*) * count);
+	memset(names, 0, sizeof(void*) * count);
+	return names;
+}
+
+const wchar_t* prEntryName(PacReader* reader, u32 index) {
+	if (reader->cache)
+		return icWideName(reader->cache, index);
+	if (reader->names == NULL)
+		reader->names = (wchar_t**)allocNames(reader->header->entryCount);
+	if (reader->names[index] == NULL)
+		reader->names[index] = toWCString(reader->entries[index].name, CODE_PAGE_SHIFT_JIS);
+	return reader->names[index];
+}
+
+const char* prEntryUTF8Name(PacReader* reader, u32 index) {
+	if (reader->cache)
+		return icUTF8Name(reader->cache, index);
+	if (reader->utf8Names == NULL)
+		reader->utf8Names = (char**)allocNames(reader->header->entryCount);
+	if (reader->utf8Names[index] == NULL)
+		reader->utf8Names[index] = toUTF8String(prEntryName(reader, index));
+	return reader->utf8Names[index];
+}
+
+/**
+ * The hash table is built over the index on the first lookup, or comes
+ * ready-made with the index cache.
+ */
+i32 prFindEntry(PacReader* reader, const wchar_t* name) {
+	const NameTable* lookup = NULL;
+	if (reader->cache) {
+		lookup = icNameTable(reader->cache);
+	} else {
+		if (reader->table == NULL && reader->header->entryCount > 0)
+			reader->table = newNameTable(reader->entries[0].name, sizeof(reader->entries[0].name),
+					sizeof(IndexEntry), reader->header->entryCount);
+		lookup = reader->table;
+	}
+	if (lookup == NULL) return -1;
+
+	/// A name Shift-JIS cannot represent is in no package.
+	char* mbName = toMBString(name, CODE_PAGE_SHIFT_JIS);
+	if (mbName == NULL) return -1;
+	i32 index = ntFind(lookup, mbName);
+	free(mbName);
+	return index;
+}
+
+/**
+ * In Variant 4 an entry is deflated only if that made it smaller,
+ * Variant 1 packages have every entry LZSS-encoded, and Variant 2 every
+ * entry huffman-encoded.
+ */
+bool prIsStored(const PacReader* reader, u32 index) {
+	u32 vtag = reader->header->variantTag;
+	if (vtag == CONTENT_MAYBE_DEFLATE)
+		return reader->entries[index].decodedLen <= reader->entries[index].encodedLen;
+	return vtag == CONTENT_NOT_COMPRESSED;
+}
+
+/// Without a codec context, the decoders are set up for this entry alone.
+static bool decodeInto(const PacReader* reader, CodecContext* codec, u32 index, const byte* encoded, byte* buffer) {
+	const IndexEntry* entry = &(reader->entries[index]);
+	if (prIsStored(reader, index)) {
+		memcpy(buffer, encoded, entry->decodedLen);
+		return true;
+	}
+	if (reader->header->variantTag == CONTENT_LZSS) {
+		/// Like lzssDecode(), a short stream just leaves the rest zeroed.
+		lzssDecodeTo(encoded, entry->encodedLen, buffer, entry->decodedLen);
+		return true;
+	}
+	if (reader->header->variantTag == CONTENT_HUFFMAN) {
+		/// An empty entry has no codes, not even a tree.
+		if (entry->decodedLen == 0) return true;
+		return codec
+				? huffmanDecodeWith(ccHuffmanDecoder(codec), L"Entry Content",
+						encoded, entry->encodedLen, buffer, entry->decodedLen)
+				: huffmanDecodeTo(L"Entry Content", encoded, entry->encodedLen, buffer, entry->decodedLen);
+	}
+
+	if (codec) return ccInflate(codec, encoded, entry->encodedLen, buffer, entry->decodedLen);
+	unsigned long decodedLen = entry->decodedLen;
+	return uncompress(buffer, &decodedLen, encoded, entry->encodedLen) == Z_OK
+			&& decodedLen == entry->decodedLen;
+}
+
+/// With a codec context, buffer is NULL, and the context's buffers are used.
+static const byte* readEntry(PacReader* reader, CodecContext* codec, u32 index, byte* buffer, u32 bufferSize) {
+	if (index >= reader->header->entryCount) return NULL;
+	const IndexEntry* entry = &(reader->entries[index]);
+	bool stored = prIsStored(reader, index);
+	/// A stored entry should never be shorter than what the index says.
+	if (stored && entry->encodedLen < entry->decodedLen) return NULL;
+
+	if (reader->map) {
+		if (!mfContains(reader->map, entry->offset, entry->encodedLen)) return NULL;
+		const byte* encoded = mfData(reader->map) + entry->offset;
+		if (stored) return encoded;
+		if (codec) {
+			bufferSize = entry->decodedLen;
+			buffer = ccOutputBuffer(codec, bufferSize);
+		}
+		if (buffer == NULL || bufferSize < entry->decodedLen) return NULL;
+		mfWillNeed(reader->map, entry->offset, entry->encodedLen);
+		return decodeInto(reader, codec, index, encoded, buffer) ? buffer : NULL;
+	}
+
+	if (codec) {
+		bufferSize = entry->decodedLen;
+		buffer = ccOutputBuffer(codec, bufferSize);
+	}
+	if (buffer == NULL || bufferSize < entry->decodedLen) return NULL;
+	/// Stored entries are read right into the buffer, the others need a temporary copy.
+	ByteArray* encodedData = (stored || codec) ? NULL : newByteArray(entry->encodedLen);
+	byte* target = stored ? buffer : codec ? ccInputBuffer(codec, entry->encodedLen) : baData(encodedData);
+	if (target == NULL) return NULL;
+	u32 length = stored ? entry->decodedLen : entry->encodedLen;
+
+	EnterCriticalSection(&(reader->lock));
+	bool result = prReadAt(reader, reader->file, entry->offset, length, target);
+	LeaveCriticalSection(&(reader->lock));
+
+	if (result && !stored)
+		result = decodeInto(reader, codec, index, target, buffer);
+	if (encodedData) deleteByteArray(encodedData);
+	return result ? buffer : NULL;
+}
+
+const byte* prReadEntry(PacReader* reader, u32 index, byte* buffer, u32 bufferSize) {
+	return readEntry(reader, NULL, index, buffer, bufferSize);
+}
+
+const byte* prReadEntryWith(PacReader* reader, CodecContext* codec, u32 index) {
+	return readEntry(reader, codec, index, NULL, 0);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file		PacReader.h
+ * @brief		Read access to the entries of a PAC file, for embedding
+ * 				into other programs (libzbspac).
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef PAC_READER_H_INCLUDED
+#define PAC_READER_H_INCLUDED
+
+#include <stdio.h>
+
+#include "CommonDef.h"
+#include "NexasFormat.h"
+#include "MappedFile.h"
+
+struct PacReader;
+typedef struct PacReader PacReader;
+
+/**
+ * Only declared here, CodecContext.h is for the library itself and brings
+ * in zlib.h, which users of the library need not have.
+ */
+#ifndef CODEC_CONTEXT_DECLARED
+#define CODEC_CONTEXT_DECLARED
+struct CodecContext;
+typedef struct CodecContext CodecContext;
+#endif
+
+/**
+ * Opens a package and reads its index. With useCache, the decoded index
+ * is taken from (or saved to) the package.pac.pacidx sidecar file.
+ * Returns NULL if the package cannot be opened or is not supported.
+ */
+PacReader* openPacReader(const wchar_t* packagePath, bool useCache);
+void closePacReader(PacReader* reader);
+
+u32 prEntryCount(const PacReader* reader);
+u32 prVariant(const PacReader* reader);
+const IndexEntry* prEntries(const PacReader* reader);
+
+/**
+ * The names are converted on first use and kept by the reader, so do not
+ * call these from several threads at once unless the names come from the
+ * index cache, which needs no conversion.
+ */
+const wchar_t* prEntryName(PacReader* reader, u32 index);
+const char* prEntryUTF8Name(PacReader* reader, u32 index);
+
+/// Returns the index of the entry, or -1 if there is no such entry. Case is ignored.
+i32 prFindEntry(PacReader* reader, const wchar_t* name);
+
+/**
+ * Baldr Force EXE packages (PAC Variant 1) keep a plain index right after
+ * the header, the others have it huffman-encoded at the end of the file.
+ */
+bool prHasPlainIndex(PacReader* reader);
+
+/// A stored entry is kept in the package as is, without compression.
+bool prIsStored(const PacReader* reader, u32 index);
+
+/**
+ * Returns the content of an entry, decodedLen bytes long.
+ * A stored entry in a mapped package is returned as a view into the
+ * mapping, which stays valid until the reader is closed. Otherwise the
+ * content is decoded into the buffer, which must hold at least decodedLen
+ * bytes, and the buffer is returned. Returns NULL on failure.
+ * Entries can be read from several threads at once.
+ */
+const byte* prReadEntry(PacReader* reader, u32 index, byte* buffer, u32 bufferSize);
+
+/**
+ * Like prReadEntry(), but decodes into a buffer of the codec context, with
+ * its decoders. The content stays valid until the context is used again.
+ * For a worker going through many entries, nothing is set up again.
+ */
+const byte* prReadEntryWith(PacReader* reader, CodecContext* codec, u32 index);
+
+/**
+ * Lower level access for the unpacker: the mapping (NULL if the package
+ * could not be mapped), the reader's own file handle (NULL if mapped),
+ * and reading a part of the package through either.
+ */
+const MappedFile* prMappedFile(const PacReader* reader);
+FILE* prFile(const PacReader* reader);
+bool prReadAt(const PacReader* reader, FILE* file, u64 offset, u32 length, void* buffer);
+
+#endif
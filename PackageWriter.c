@@ -0,0 +1,122 @@
+/**
+ * @file		PackageWriter.c
+ * @brief		Pieces shared by the operations that write PAC files.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <zlib.h>
+
+#include "Logger.h"
+#include "HuffmanCode.h"
+#include "PackageWriter.h"
+#include "NexasPackage.h"
+
+static LzssLevel lzssLevel = LZSS_LEVEL_TREE;
+
+void useLzssLevel(u32 level) {
+	lzssLevel = (level <= LZSS_LEVEL_OPTIMAL) ? level : LZSS_LEVEL_OPTIMAL;
+}
+
+LzssEncoder* pwNewLzssEncoder(void) {
+	return newLzssEncoder(lzssLevel);
+}
+
+ByteArray* pwReadFile(const wchar_t* name, u32 i) {
+	FILE* infile = _wfopen(name, L"rb");
+	if (infile == NULL) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to open the file!", i, name);
+		return NULL;
+	}
+	_fseeki64(infile, 0, SEEK_END);
+	i64 length = _ftelli64(infile);
+	_fseeki64(infile, 0, SEEK_SET);
+	if (length < 0 || length > 0xFFFFFFFFLL) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, The file is too large!", i, name);
+		fclose(infile);
+		return NULL;
+	}
+
+	ByteArray* data = newByteArray((u32)length);
+	if (fread(baData(data), 1, (u32)length, infile) != (u32)length) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to read the file!", i, name);
+		deleteByteArray(data);
+		data = NULL;
+	}
+	fclose(infile);
+	return data;
+}
+
+bool pwShouldCompress(const wchar_t* filename) {
+	static const wchar_t* targetExts[] = { L".ogg" };
+	size_t len = wcslen(filename);
+	for (i8 i = 0; i < 1; ++i) {
+		size_t extLen = wcslen(targetExts[i]);
+		if (len >= extLen && wcscmp(filename + len - extLen, targetExts[i]) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ByteArray* pwDeflate(const ByteArray* original) {
+	unsigned long len = compressBound(baLength(original));
+	ByteArray* encoded = newByteArray(len);
+	if (compress(baData(encoded), &len, baData(original), baLength(original)) != Z_OK
+			|| len >= baLength(original)) {
+		deleteByteArray(encoded);
+		return NULL;
+	}
+	ByteArray* result = newByteArray(len);
+	memcpy(baData(result), baData(encoded), len);
+	deleteByteArray(encoded);
+	return result;
+}
+
+ByteArray* pwHuffmanEncode(const ByteArray* original, const wchar_t* name) {
+	if (baLength(original) == 0) return NULL;
+	return huffmanEncode(name, baData(original), baLength(original));
+}
+
+bool pwWritePlainIndex(FILE* file, const ByteArray* indexes) {
+	writeLog(LOG_VERBOSE, L"Writing plain text index.");
+	if (fwrite(baData(indexes), 1, baLength(indexes), file) != baLength(indexes)) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to write the indexes to the package!");
+		return false;
+	}
+	writeLog(LOG_VERBOSE, L"Written plain text index, length is: %u.", baLength(indexes));
+	return true;
+}
+
+bool pwWriteEncodedIndex(FILE* file, const ByteArray* indexes) {
+	ByteArray* encodedIndexes =
+			huffmanEncode(L"Entry Indexes", baData(indexes), baLength(indexes));
+	if (encodedIndexes == NULL) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to encode the indexes!");
+		return false;
+	}
+
+	byte* encodedData = baData(encodedIndexes);
+	u32 encodedLen = baLength(encodedIndexes);
+	writeLog(LOG_VERBOSE, L"The length of the compressed index is %u.", encodedLen);
+	/// Important: XOR encryption!
+	for (u32 i = 0; i < encodedLen; ++i) {
+		encodedData[i] ^= 0xFF;
+	}
+
+	bool result = true;
+	if (fwrite(encodedData, 1, encodedLen, file) != encodedLen) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to write the indexes to the package!");
+		result = false;
+	} else if (fwrite(&encodedLen, 4, 1, file) != 1) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to write the index length to the package!");
+		result = false;
+	}
+	deleteByteArray(encodedIndexes);
+	return result;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file		PackageWriter.h
+ * @brief		Pieces shared by the operations that write PAC files.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef PACKAGE_WRITER_H_INCLUDED
+#define PACKAGE_WRITER_H_INCLUDED
+
+#include <stdio.h>
+
+#include "CommonDef.h"
+#include "ByteArray.h"
+#include "LzssCode.h"
+
+/// Reads a whole source file, i is the entry index, for the error messages.
+ByteArray* pwReadFile(const wchar_t* name, u32 i);
+
+/// Some files (like ogg) will not get any smaller with deflate.
+bool pwShouldCompress(const wchar_t* filename);
+
+/**
+ * Returns the deflated data, or NULL if deflating does not make the entry
+ * any smaller, then it is stored as is. The unpacker tells the two apart
+ * by comparing the lengths.
+ */
+ByteArray* pwDeflate(const ByteArray* original);
+
+/**
+ * Returns the huffman-encoded data for PAC Variant 2, or NULL for an empty
+ * entry, which is stored as is, having nothing to encode.
+ */
+ByteArray* pwHuffmanEncode(const ByteArray* original, const wchar_t* name);
+
+/// An LZSS encoder of the level chosen with useLzssLevel().
+LzssEncoder* pwNewLzssEncoder(void);
+
+/// The index of PAC Variant 1, as is, at the current position.
+bool pwWritePlainIndex(FILE* file, const ByteArray* indexes);
+/// The huffman-encoded index and its length, at the current position.
+bool pwWriteEncodedIndex(FILE* file, const ByteArray* indexes);
+
+#endif
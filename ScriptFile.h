@@ -9,8 +9,30 @@
 #define COMPILED_SCRIPT_FILE_H_INCLUDED
 
 #include "CommonDef.h"
+#include "ByteArray.h"
 
 bool unpackScript(const wchar_t* sourcePath, const wchar_t* targetPath);
+/**
+ * Unpacks every *.bin script in a directory, or in a package, on threadCount
+ * workers. Each script goes to targetDir\<name without .bin>. Files that
+ * turn out not to be scripts are skipped.
+ */
+bool unpackScripts(const wchar_t* sourcePath, const wchar_t* targetDir, bool useCache, u32 threadCount);
+/**
+ * Skips the script if scripts.manifest beside the target file says it was
+ * packed from the very same parts, and the target file is unchanged since.
+ */
 bool packScript(const wchar_t* sourcePath, const wchar_t* targetPath);
+/**
+ * Packs every subdirectory of scriptsDir that has a script.txt to
+ * targetDir\<directory name>.bin on threadCount workers, only the ones
+ * changed since the last time. scripts.manifest in targetDir keeps track.
+ */
+bool packScripts(const wchar_t* scriptsDir, const wchar_t* targetDir, u32 threadCount);
+/**
+ * Puts head.bin, script.txt and tail.bin of an unpacked script back
+ * together in memory, returns NULL if any of them cannot be read.
+ */
+ByteArray* buildScript(const wchar_t* sourcePath);
 
 #endif /* COMPILEDSCRIPTFILE_H_ */
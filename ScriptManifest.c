@@ -0,0 +1,229 @@
+/**
+ * @file		ScriptManifest.c
+ * @brief		A record (scripts.manifest) of what every packed script was
+ * 				built from, so unchanged scripts need not be packed again.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+/**
+ * The manifest file is laid out as:
+ *
+ * ManifestHeader
+ * ManifestRecord[recordCount]  -- sorted by name, case insensitive
+ *
+ * Like the index cache, it is only meant for the machine that made it,
+ * so native byte order and sizeof(wchar_t) are fine.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "Logger.h"
+#include "StringUtils.h"
+#include "Hash64.h"
+#include "ScriptManifest.h"
+
+#define MANIFEST_MAGIC "ZBSPMAN"
+/// Bump this whenever the script packer would build different output from the same parts.
+#define MANIFEST_VERSION 1
+#define MANIFEST_NAME_LEN 64
+
+struct ManifestHeader {
+	char magic[8];
+	u32 version;
+	u32 recordCount;
+	u32 wideCharSize;
+	u32 reserved;
+};
+typedef struct ManifestHeader ManifestHeader;
+
+struct ManifestRecord {
+	wchar_t name[MANIFEST_NAME_LEN];
+	ScriptStamp stamp;
+};
+typedef struct ManifestRecord ManifestRecord;
+
+struct ScriptManifest {
+	ManifestRecord* records;
+	u32 count;
+	u32 capacity;
+};
+
+/// The parts are small, so they are simply read whole.
+static bool hashFile(const wchar_t* path, u64* hash) {
+	FILE* file = _wfopen(path, L"rb");
+	if (!file) return false;
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	byte* data = length >= 0 ? malloc(length > 0 ? length : 1) : NULL;
+	bool result = data != NULL && fread(data, 1, length, file) == (size_t)length;
+	fclose(file);
+	if (result) *hash = hash64(data, length, 0);
+	free(data);
+	return result;
+}
+
+static bool hashPart(const wchar_t* sourceDir, const wchar_t* part, u64* hash) {
+	wchar_t* path = wcsAppend(sourceDir, part);
+	bool result = hashFile(path, hash);
+	free(path);
+	return result;
+}
+
+bool stampScriptSource(const wchar_t* sourceDir, ScriptStamp* stamp) {
+	memset(stamp, 0, sizeof(ScriptStamp));
+	return hashPart(sourceDir, L"\\head.bin", &(stamp->headHash))
+			&& hashPart(sourceDir, L"\\script.txt", &(stamp->textHash))
+			&& hashPart(sourceDir, L"\\tail.bin", &(stamp->tailHash));
+}
+
+u64 hashScriptOutput(const byte* data, u32 length) {
+	return hash64(data, length, 0);
+}
+
+wchar_t* scriptManifestPath(const wchar_t* targetDir) {
+	return wcsAppend(targetDir, L"\\scripts.manifest");
+}
+
+ScriptManifest* newScriptManifest(void) {
+	ScriptManifest* manifest = malloc(sizeof(ScriptManifest));
+	memset(manifest, 0, sizeof(ScriptManifest));
+	return manifest;
+}
+
+void deleteScriptManifest(ScriptManifest* manifest) {
+	if (!manifest) return;
+	free(manifest->records);
+	free(manifest);
+	manifest = NULL;
+}
+
+ScriptManifest* loadScriptManifest(const wchar_t* path) {
+	ScriptManifest* manifest = newScriptManifest();
+	FILE* file = _wfopen(path, L"rb");
+	if (!file) {
+		writeLog(LOG_VERBOSE, L"No script manifest found.");
+		return manifest;
+	}
+
+	ManifestHeader header;
+	bool result = fread(&header, sizeof(ManifestHeader), 1, file) == 1
+			&& memcmp(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) == 0
+			&& header.version == MANIFEST_VERSION
+			&& header.wideCharSize == sizeof(wchar_t);
+	if (result && header.recordCount > 0) {
+		manifest->records = malloc(sizeof(ManifestRecord) * header.recordCount);
+		manifest->capacity = header.recordCount;
+		result = fread(manifest->records, sizeof(ManifestRecord), header.recordCount, file) == header.recordCount;
+	}
+	fclose(file);
+
+	if (!result) {
+		writeLog(LOG_VERBOSE, L"The script manifest is invalid, all scripts will be packed.");
+		free(manifest->records);
+		memset(manifest, 0, sizeof(ScriptManifest));
+		return manifest;
+	}
+	manifest->count = header.recordCount;
+	for (u32 i = 0; i < manifest->count; ++i) {
+		manifest->records[i].name[MANIFEST_NAME_LEN - 1] = L'\0';
+	}
+	return manifest;
+}
+
+/**
+ * Write to a temporary file first, so a half written manifest is never
+ * taken for a good one.
+ */
+bool saveScriptManifest(ScriptManifest* manifest, const wchar_t* path) {
+	ManifestHeader header;
+	memset(&header, 0, sizeof(ManifestHeader));
+	memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+	header.version = MANIFEST_VERSION;
+	header.recordCount = manifest->count;
+	header.wideCharSize = sizeof(wchar_t);
+
+	wchar_t* tempPath = wcsAppend(path, L".tmp");
+	FILE* file = _wfopen(tempPath, L"wb");
+	bool result = file != NULL
+			&& fwrite(&header, sizeof(ManifestHeader), 1, file) == 1
+			&& fwrite(manifest->records, sizeof(ManifestRecord), manifest->count, file) == manifest->count;
+	if (file) result = (fclose(file) == 0) && result;
+	if (result) {
+		_wremove(path);
+		result = _wrename(tempPath, path) == 0;
+	}
+	if (!result) {
+		_wremove(tempPath);
+		writeLog(LOG_VERBOSE, L"Unable to write the script manifest: %s", path);
+	} else {
+		writeLog(LOG_VERBOSE, L"Script manifest written: %s", path);
+	}
+	free(tempPath);
+	return result;
+}
+
+/// Returns where the name is, or where it should be inserted, in the sorted records.
+static u32 findRecord(const ScriptManifest* manifest, const wchar_t* name, bool* found) {
+	u32 low = 0;
+	u32 high = manifest->count;
+	*found = false;
+	while (low < high) {
+		u32 middle = low + (high - low) / 2;
+		int order = _wcsicmp(manifest->records[middle].name, name);
+		if (order == 0) {
+			*found = true;
+			return middle;
+		}
+		if (order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+bool smIsUpToDate(const ScriptManifest* manifest, const wchar_t* name,
+		ScriptStamp* stamp, const wchar_t* outputPath) {
+	bool found = false;
+	u32 index = findRecord(manifest, name, &found);
+	if (!found) return false;
+
+	const ScriptStamp* recorded = &(manifest->records[index].stamp);
+	if (recorded->headHash != stamp->headHash
+			|| recorded->textHash != stamp->textHash
+			|| recorded->tailHash != stamp->tailHash)
+		return false;
+
+	/// The .bin may have been deleted, or overwritten by something else.
+	u64 outputHash = 0;
+	if (!hashFile(outputPath, &outputHash) || outputHash != recorded->outputHash)
+		return false;
+	stamp->outputHash = outputHash;
+	return true;
+}
+
+void smRecord(ScriptManifest* manifest, const wchar_t* name, const ScriptStamp* stamp) {
+	/// A name too long to keep is left out, its script is then always packed.
+	if (wcslen(name) >= MANIFEST_NAME_LEN) return;
+
+	bool found = false;
+	u32 index = findRecord(manifest, name, &found);
+	if (!found) {
+		if (manifest->count == manifest->capacity) {
+			manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 64;
+			manifest->records = realloc(manifest->records, sizeof(ManifestRecord) * manifest->capacity);
+		}
+		memmove(manifest->records + index + 1, manifest->records + index,
+				sizeof(ManifestRecord) * (manifest->count - index));
+		++(manifest->count);
+		memset(&(manifest->records[index]), 0, sizeof(ManifestRecord));
+		wcsncpy(manifest->records[index].name, name, MANIFEST_NAME_LEN - 1);
+	}
+	manifest->records[index].stamp = *stamp;
+}
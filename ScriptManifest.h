@@ -0,0 +1,58 @@
+/**
+ * @file		ScriptManifest.h
+ * @brief		A record (scripts.manifest) of what every packed script was
+ * 				built from, so unchanged scripts need not be packed again.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef SCRIPT_MANIFEST_H_INCLUDED
+#define SCRIPT_MANIFEST_H_INCLUDED
+
+#include "CommonDef.h"
+
+/**
+ * The hashes of the three parts of an unpacked script, and of the .bin
+ * built from them. If any of the files changes, so does its hash.
+ */
+struct ScriptStamp {
+	u64 headHash;
+	u64 textHash;
+	u64 tailHash;
+	u64 outputHash;
+};
+typedef struct ScriptStamp ScriptStamp;
+
+struct ScriptManifest;
+typedef struct ScriptManifest ScriptManifest;
+
+/// Hashes head.bin, script.txt and tail.bin, returns false if any cannot be read.
+bool stampScriptSource(const wchar_t* sourceDir, ScriptStamp* stamp);
+u64 hashScriptOutput(const byte* data, u32 length);
+
+/// The manifest kept in the directory of the .bin files, next to them.
+wchar_t* scriptManifestPath(const wchar_t* targetDir);
+
+/**
+ * Loads a manifest. A missing, damaged or outdated one is taken as empty,
+ * then every script is simply packed again.
+ */
+ScriptManifest* loadScriptManifest(const wchar_t* path);
+ScriptManifest* newScriptManifest(void);
+void deleteScriptManifest(ScriptManifest* manifest);
+/// Failing to save is not fatal, the scripts will only be packed again next time.
+bool saveScriptManifest(ScriptManifest* manifest, const wchar_t* path);
+
+/**
+ * A script is up to date if the manifest has it built from the same parts,
+ * and the .bin at outputPath is still the very one built then.
+ * The name is that of the .bin file. Lookups may run on several threads.
+ * If so, the recorded output hash is filled in, so the stamp can be kept.
+ */
+bool smIsUpToDate(const ScriptManifest* manifest, const wchar_t* name,
+		ScriptStamp* stamp, const wchar_t* outputPath);
+/// Adds or replaces the record of a script, not to be mixed with lookups on other threads.
+void smRecord(ScriptManifest* manifest, const wchar_t* name, const ScriptStamp* stamp);
+
+#endif
@@ -11,188 +11,414 @@
 #include <wchar.h>
 #include <ctype.h>
 #include <string.h>
+#include <io.h>
+#include <direct.h>
+#include <sys/stat.h>
 
 #include "Logger.h"
 #include "StringUtils.h"
+#include "FileSystem.h"
+#include "ThreadPool.h"
+#include "ScriptManifest.h"
 #include "ScriptFile.h"
 
-static bool getNextMeaningfulLine(FILE* file, wchar_t* buf, u32 size) {
-	while (fgetws(buf, CBUF_TRY_SIZE, file) != NULL) {
+/**
+ * script.txt (UTF-16LE) is read in one go and split into lines here. The
+ * current line is copied out without its line break into a buffer that
+ * grows as needed, so a line may be as long as the translator likes.
+ */
+struct LineReader {
+	const byte* data;
+	u32 length;
+	u32 next;
+	wchar_t* line;
+	u32 capacity;
+};
+typedef struct LineReader LineReader;
+
+static bool nextLine(LineReader* reader) {
+	if (reader->next + 1 >= reader->length) return false;
+
+	u32 count = 0;
+	while (reader->next + 1 < reader->length) {
+		wchar_t c = reader->data[reader->next] | (reader->data[reader->next + 1] << 8);
+		reader->next += 2;
+		if (c == L'\n') break;
+		if (count + 1 >= reader->capacity) {
+			reader->capacity = reader->capacity ? reader->capacity * 2 : 256;
+			reader->line = realloc(reader->line, sizeof(wchar_t) * reader->capacity);
+		}
+		reader->line[count++] = c;
+	}
+	if (reader->line == NULL) {
+		reader->capacity = 256;
+		reader->line = malloc(sizeof(wchar_t) * reader->capacity);
+	}
+	if (count > 0 && reader->line[count - 1] == L'\r') --count;
+	reader->line[count] = L'\0';
+	return true;
+}
+
+/// Blank lines and comments (starting with '#') are skipped.
+static bool nextMeaningfulLine(LineReader* reader) {
+	while (nextLine(reader)) {
 		u32 index = 0;
-		while (buf[index] == L' ' || buf[index] == L'\t') ++index;
-		if (buf[index] == L'\r' || buf[index] == L'#') continue;
+		while (reader->line[index] == L' ' || reader->line[index] == L'\t') ++index;
+		if (reader->line[index] == L'\0' || reader->line[index] == L'#') continue;
 		return true;
 	}
 	return false;
 }
 
-static bool appendFile(FILE* targetFile, wchar_t* sourcePath) {
-	FILE* sourceFile = _wfopen(sourcePath, L"rb");
-	if (!sourceFile) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to open %s for reading!", sourcePath);
-		return false;
+/// The text section is only as long as the translation makes it, so it grows as it is written.
+struct TextBuffer {
+	byte* data;
+	u32 length;
+	u32 capacity;
+};
+typedef struct TextBuffer TextBuffer;
+
+static byte* tbReserve(TextBuffer* text, u32 length) {
+	if (text->length + length > text->capacity) {
+		while (text->length + length > text->capacity)
+			text->capacity = text->capacity ? text->capacity * 2 : 4096;
+		text->data = realloc(text->data, text->capacity);
 	}
+	byte* result = text->data + text->length;
+	text->length += length;
+	return result;
+}
 
-	fseek(sourceFile, 0, SEEK_END);
-	int length = ftell(sourceFile);
-	if (length < 0) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to determine the length of %s!", sourcePath);
-		fclose(sourceFile);
-		return false;
+/// Opens the head or the tail of a script, and tells how long it is.
+static FILE* openPart(const wchar_t* path, u32* length) {
+	FILE* file = _wfopen(path, L"rb");
+	if (!file) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to open %s for reading!", path);
+		return NULL;
 	}
 
-	fseek(sourceFile, 0, SEEK_SET);
-	byte* data = malloc(sizeof(byte) * length);
-	if (fread(data, sizeof(byte), length, sourceFile) != length) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read %s!", sourcePath);
-		fclose(sourceFile);
-		return false;
+	fseek(file, 0, SEEK_END);
+	long fileLength = ftell(file);
+	if (fileLength < 0) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to determine the length of %s!", path);
+		fclose(file);
+		return NULL;
 	}
-	fclose(sourceFile);
+	fseek(file, 0, SEEK_SET);
+	*length = fileLength;
+	return file;
+}
 
-	if (fwrite(data, sizeof(byte), length, targetFile) != length) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write to the target file!");
+static bool readPart(FILE* file, const wchar_t* path, byte* target, u32 length) {
+	if (fread(target, sizeof(byte), length, file) != length) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read %s!", path);
 		return false;
 	}
 	return true;
 }
 
-static bool writeTextSection(FILE* compiledScript, wchar_t* textPath) {
-	FILE* plainScript = _wfopen(textPath, L"rb");
-	if (!plainScript) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to open %s for reading!", textPath);
-		return false;
-	}
-
-	wchar_t buf[CBUF_TRY_SIZE];
-	wchar_t encoding[CBUF_TRY_SIZE];
+static bool writeTextSection(TextBuffer* text, LineReader* reader) {
 	u32 count = 0;
 
-	/// Skip the BOM.
-	fseek(plainScript, 2, SEEK_SET);
-
 	/// Get the encoding and segment count.
-	if (!getNextMeaningfulLine(plainScript, buf, CBUF_TRY_SIZE)) {
+	if (!nextMeaningfulLine(reader)) {
 		writeLog(LOG_QUIET, L"ERROR: script.txt: header not found!");
-		fclose(plainScript);
 		return false;
 	}
 
-	if (swscanf(buf, L"ZBSPAC-TRANSLATION ENCODING %s COUNT %u", encoding, &count) != 2) {
+	wchar_t* encoding = newWCString(wcslen(reader->line));
+	if (swscanf(reader->line, L"ZBSPAC-TRANSLATION ENCODING %s COUNT %u", encoding, &count) != 2) {
 		writeLog(LOG_QUIET, L"ERROR: header is corrupt");
-		fclose(plainScript);
+		free(encoding);
+		return false;
+	}
+
+	u32 codePage = 0;
+	if (!codePageOf(encoding, &codePage)) {
+		writeLog(LOG_QUIET, L"ERROR: Unknown encoding: %s", encoding);
+		free(encoding);
 		return false;
 	}
 
 	writeLog(LOG_NORMAL, L"The script's encoding is %s, has %u strings.", encoding, count);
+	free(encoding);
 
 	for (u32 i = 0; i < count; ++i) {
-		if (!getNextMeaningfulLine(plainScript, buf, CBUF_TRY_SIZE)) {
+		if (!nextMeaningfulLine(reader)) {
 			writeLog(LOG_QUIET, L"ERROR: Unable to read Segment %u!", i);
-			fclose(plainScript);
 			return false;
 		}
 
 		u32 serial, nullCount;
-		if (swscanf(buf, L"SEG %u NULL %u", &serial, &nullCount) != 2) {
+		if (swscanf(reader->line, L"SEG %u NULL %u", &serial, &nullCount) != 2) {
 			writeLog(LOG_QUIET, L"ERROR: Unable to read the serial and number of following nulls for Segment %u!", i);
-			fclose(plainScript);
 			return false;
 		}
 
 		if (serial != i) {
 			writeLog(LOG_QUIET, L"ERROR: Segment %u's serial number is %u. They are not equal!", i, serial);
-			fclose(plainScript);
 			return false;
 		}
 
-		bool isText = (wcsstr(buf, L"NOT-TEXT") == NULL);
-
-		/// This line is the original text.
-		fgetws(buf, CBUF_TRY_SIZE, plainScript);
-		/// The separator.
-		fgetws(buf, CBUF_TRY_SIZE, plainScript);
+		bool isText = (wcsstr(reader->line, L"NOT-TEXT") == NULL);
 
-		/// Then the altered text.
-		if (fgetws(buf, CBUF_TRY_SIZE, plainScript) == NULL) {
+		/// The original text, the separator, then the altered text.
+		if (!nextLine(reader) || !nextLine(reader) || !nextLine(reader)) {
 			writeLog(LOG_QUIET, L"ERROR: Unable to read Segment %u!", i);
-			fclose(plainScript);
 			return false;
 		}
-		/// Discard the CRLF.
-		buf[wcslen(buf) - 2] = L'\0';
 
 		char* mbText = isText
-				? toMBString(buf, encoding)
-				: toMBString(buf, L"japanese");
+				? toMBString(reader->line, codePage)
+				: toMBString(reader->line, CODE_PAGE_SHIFT_JIS);
 
 		if (mbText == NULL) {
-			writeLog(LOG_QUIET, L"ERROR: Unable to convert Segment %u to the target encoding: %s", i, buf);
+			writeLog(LOG_QUIET, L"ERROR: Unable to convert Segment %u to the target encoding: %s", i, reader->line);
 			return false;
 		}
 
 		u32 mbLen = strlen(mbText);
-		if (fwrite(mbText, 1, mbLen, compiledScript) != mbLen) {
-			writeLog(LOG_QUIET, L"ERROR: Unable to write Segment %u to the target file : %s",
-				i, buf);
-			free(mbText);
-			return false;
-		}
-
-		for (u32 j = 0; j < nullCount; ++j) {
-			fputc('\0', compiledScript);
-		}
+		memcpy(tbReserve(text, mbLen), mbText, mbLen);
+		memset(tbReserve(text, nullCount), 0, nullCount);
 		free(mbText);
 	}
-	fclose(plainScript);
 	return true;
 }
 
-static bool doPack(const wchar_t* sourcePath, const wchar_t* targetPath) {
+/// The whole of script.txt is read at once, past its BOM.
+static bool readText(TextBuffer* text, const wchar_t* textPath) {
+	u32 length = 0;
+	FILE* file = openPart(textPath, &length);
+	if (!file) return false;
+	byte* data = malloc(length > 0 ? length : 1);
+	bool result = readPart(file, textPath, data, length);
+	fclose(file);
+
+	if (result) {
+		LineReader reader = { data, length, 0, NULL, 0 };
+		if (length >= 2 && data[0] == 0xFF && data[1] == 0xFE) reader.next = 2;
+		result = writeTextSection(text, &reader);
+		free(reader.line);
+	}
+	free(data);
+	return result;
+}
 
+ByteArray* buildScript(const wchar_t* sourcePath) {
 	wchar_t* headPath = wcsAppend(sourcePath, L"\\head.bin");
 	wchar_t* tailPath = wcsAppend(sourcePath, L"\\tail.bin");
 	wchar_t* textPath = wcsAppend(sourcePath, L"\\script.txt");
 
-	FILE* targetFile = _wfopen(targetPath, L"wb");
+	TextBuffer text = { NULL, 0, 0 };
+	u32 headLen = 0;
+	u32 tailLen = 0;
+	FILE* headFile = openPart(headPath, &headLen);
+	FILE* tailFile = headFile ? openPart(tailPath, &tailLen) : NULL;
+
+	/// The head and the tail are read right into place around the text.
+	ByteArray* script = NULL;
+	if (tailFile && readText(&text, textPath)) {
+		script = newByteArray(headLen + text.length + tailLen);
+		byte* data = baData(script);
+		if (text.length > 0) memcpy(data + headLen, text.data, text.length);
+		if (!readPart(headFile, headPath, data, headLen)
+				|| !readPart(tailFile, tailPath, data + headLen + text.length, tailLen)) {
+			deleteByteArray(script);
+			script = NULL;
+		}
+	}
+
+	if (headFile) fclose(headFile);
+	if (tailFile) fclose(tailFile);
+	free(text.data);
+	free(headPath); free(tailPath); free(textPath);
+	return script;
+}
+
+/// The hash of what was written goes to outputHash, for the manifest.
+static bool doPack(const wchar_t* sourcePath, const wchar_t* targetPath, u64* outputHash) {
+	ByteArray* script = buildScript(sourcePath);
+	if (!script) return false;
 
+	FILE* targetFile = _wfopen(targetPath, L"wb");
+	bool result = false;
 	if (!targetFile) {
 		writeLog(LOG_QUIET, L"ERROR: Unable to open the target file for writing!");
-		free(headPath); free(tailPath); free(textPath);
-		return false;
+	} else {
+		result = fwrite(baData(script), 1, baLength(script), targetFile) == baLength(script);
+		if (fclose(targetFile) != 0) result = false;
+		if (!result) writeLog(LOG_QUIET, L"ERROR: Unable to write to the target file!");
 	}
+	*outputHash = hashScriptOutput(baData(script), baLength(script));
+	deleteByteArray(script);
+	return result;
+}
 
-	/// Write the head section.
-	if (!appendFile(targetFile, headPath)) {
-		free(headPath); free(tailPath); free(textPath);
-		fclose(targetFile);
-		return false;
-	}
+/**
+ * The manifest lives in the directory of the .bin, and knows the script by
+ * the name of the .bin. A script whose parts and .bin are unchanged since
+ * it was last packed is left alone.
+ */
+bool packScript(const wchar_t* sourcePath, const wchar_t* targetPath) {
+	writeLog(LOG_NORMAL, L"Packing Plain text script: %s", sourcePath);
+	writeLog(LOG_NORMAL, L"To File: %s", targetPath);
 
-	/// Write the text section.
-	if (!writeTextSection(targetFile, textPath)) {
-		free(headPath); free(tailPath); free(textPath);
-		fclose(targetFile);
-		return false;
+	i32 lastBackslashLoc = wcsFindChar(targetPath, L'\\', false);
+	wchar_t* targetDir = (lastBackslashLoc >= 0)
+			? wcsSubstring(targetPath, 0, lastBackslashLoc) : cloneWCString(L".");
+	const wchar_t* name = targetPath + lastBackslashLoc + 1;
+	wchar_t* manifestPath = scriptManifestPath(targetDir);
+	ScriptManifest* manifest = loadScriptManifest(manifestPath);
+
+	ScriptStamp stamp;
+	bool stamped = stampScriptSource(sourcePath, &stamp);
+	bool result;
+	if (stamped && smIsUpToDate(manifest, name, &stamp, targetPath)) {
+		writeLog(LOG_NORMAL, L"The target file is up to date, skipped.");
+		result = true;
+	} else {
+		result = doPack(sourcePath, targetPath, &(stamp.outputHash));
+		if (result && stamped) {
+			smRecord(manifest, name, &stamp);
+			saveScriptManifest(manifest, manifestPath);
+		}
 	}
 
-	/// Write the tail section.
-	if (!appendFile(targetFile, tailPath)) {
-		free(headPath); free(tailPath); free(textPath);
-		fclose(targetFile);
-		return false;
+	deleteScriptManifest(manifest);
+	free(manifestPath);
+	free(targetDir);
+	writeLog(LOG_NORMAL, (result) ? L"Packing Successful." : L"ERROR: Packing Failed.");
+	return result;
+}
+
+/**
+ * A script found by pack-scripts: a subdirectory of the scripts directory
+ * that has a script.txt. It is packed to targetDir\<directory name>.bin.
+ */
+struct PackItem {
+	wchar_t* name;
+	wchar_t* sourcePath;
+	wchar_t* targetPath;
+	ScriptStamp stamp;
+	bool stamped;
+	bool upToDate;
+	bool done;
+};
+typedef struct PackItem PackItem;
+
+/// Everything the workers of pack-scripts share.
+struct PackJob {
+	const ScriptManifest* manifest;
+	PackItem* items;
+	u32 count;
+	u32 capacity;
+};
+typedef struct PackJob PackJob;
+
+static void addPackItem(PackJob* job, const wchar_t* scriptsDir, const wchar_t* targetDir,
+		const wchar_t* dirName) {
+	if (job->count == job->capacity) {
+		job->capacity = job->capacity ? job->capacity * 2 : 64;
+		job->items = realloc(job->items, sizeof(PackItem) * job->capacity);
 	}
+	PackItem* item = &(job->items[job->count++]);
+	memset(item, 0, sizeof(PackItem));
+	item->name = wcsAppend(dirName, L".bin");
+	item->sourcePath = fsCombinePath(scriptsDir, dirName);
+	item->targetPath = fsCombinePath(targetDir, item->name);
+}
 
-	fclose(targetFile);
-	return true;
+/// The caller has already moved into the scripts directory.
+static void findScriptDirs(PackJob* job, const wchar_t* scriptsDir, const wchar_t* targetDir) {
+	struct _wfinddata_t foundFile;
+	intptr_t handle = _wfindfirst(L"*", &foundFile);
+	int status = (handle == -1) ? -1 : 0;
+	while (status == 0) {
+		if ((foundFile.attrib & _A_SUBDIR) != 0
+				&& wcscmp(foundFile.name, L".") != 0 && wcscmp(foundFile.name, L"..") != 0) {
+			wchar_t* textPath = wcsAppend(foundFile.name, L"\\script.txt");
+			struct _stat64 st;
+			if (_wstat64(textPath, &st) == 0)
+				addPackItem(job, scriptsDir, targetDir, foundFile.name);
+			else
+				writeLog(LOG_VERBOSE, L"%s has no script.txt, passed over.", foundFile.name);
+			free(textPath);
+		}
+		status = _wfindnext(handle, &foundFile);
+	}
+	if (handle != -1) _findclose(handle);
 }
 
-bool packScript(const wchar_t* sourcePath, const wchar_t* targetPath) {
-	writeLog(LOG_NORMAL, L"Packing Plain text script: %s", sourcePath);
-	writeLog(LOG_NORMAL, L"To File: %s", targetPath);
+/// The manifest is only looked up here, the new one is made after the pool is done.
+static bool packScriptItem(void* context, u32 workerIndex, u32 i) {
+	PackJob* job = context;
+	PackItem* item = &(job->items[i]);
+
+	item->stamped = stampScriptSource(item->sourcePath, &(item->stamp));
+	if (item->stamped && smIsUpToDate(job->manifest, item->name, &(item->stamp), item->targetPath)) {
+		writeLog(LOG_VERBOSE, L"Up to date: %s", item->name);
+		item->upToDate = true;
+		item->done = true;
+		return true;
+	}
 
-	bool result = doPack(sourcePath, targetPath);
+	item->done = doPack(item->sourcePath, item->targetPath, &(item->stamp.outputHash));
+	if (item->done)
+		writeLog(LOG_NORMAL, L"Packed: %s", item->name);
+	else
+		writeLog(LOG_QUIET, L"ERROR: %s, Packing failed!", item->name);
+	return item->done;
+}
+
+bool packScripts(const wchar_t* scriptsDir, const wchar_t* targetDir, u32 threadCount) {
+	writeLog(LOG_NORMAL, L"Packing Scripts under: %s", scriptsDir);
+	writeLog(LOG_NORMAL, L"To Directory: %s", targetDir);
+	/// The target defaults to the scripts directory, which must not be made up.
+	if (_wchdir(scriptsDir) != 0) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to read the scripts directory!");
+		return false;
+	}
+	if (!fsEnsureDirectoryExists(targetDir)) {
+		writeLog(LOG_QUIET, L"ERROR: Target directory does not exist and cannot be created.");
+		return false;
+	}
+	_wchdir(scriptsDir);
+
+	PackJob job;
+	memset(&job, 0, sizeof(PackJob));
+	findScriptDirs(&job, scriptsDir, targetDir);
+	writeLog(LOG_NORMAL, L"Found %u scripts.", job.count);
+
+	wchar_t* manifestPath = scriptManifestPath(targetDir);
+	ScriptManifest* manifest = loadScriptManifest(manifestPath);
+	job.manifest = manifest;
+	bool result = poolRunTasks(threadCount, NULL, job.count, packScriptItem, &job);
+	deleteScriptManifest(manifest);
+
+	/**
+	 * The new manifest holds exactly the scripts packed or found up to date
+	 * this time, so it is saved even if some failed.
+	 */
+	manifest = newScriptManifest();
+	u32 packedCount = 0;
+	u32 upToDateCount = 0;
+	for (u32 i = 0; i < job.count; ++i) {
+		PackItem* item = &(job.items[i]);
+		if (item->done && item->stamped) smRecord(manifest, item->name, &(item->stamp));
+		if (item->upToDate)
+			++upToDateCount;
+		else if (item->done)
+			++packedCount;
+		free(item->name);
+		free(item->sourcePath);
+		free(item->targetPath);
+	}
+	saveScriptManifest(manifest, manifestPath);
+	deleteScriptManifest(manifest);
+	free(manifestPath);
+	free(job.items);
 
+	writeLog(LOG_NORMAL, L"%u scripts packed, %u up to date.", packedCount, upToDateCount);
 	writeLog(LOG_NORMAL, (result) ? L"Packing Successful." : L"ERROR: Packing Failed.");
 	return result;
 }
@@ -42,37 +42,69 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <io.h>
+#include <direct.h>
 
 #include "Logger.h"
 #include "StringUtils.h"
 #include "Filesystem.h"
+#include "ThreadPool.h"
+#include "PacReader.h"
+#include "CodecContext.h"
 #include "ScriptFile.h"
 
+/**
+ * A compiled script is held in memory as a whole. The data is either read
+ * from a file into the buffer, or is an entry of a package, read through
+ * a PacReader and owned by it.
+ */
 struct ScriptFile {
+	const wchar_t* name;
 	u64 textOffset;
 	u32 fileLength;
-	FILE* file;
+	const char* data;
+	char* buffer;
 };
 typedef struct ScriptFile ScriptFile;
 
-static void closeScriptFile(ScriptFile* script) {
-	if (script == NULL) return;
-	if (script->file != NULL) fclose(script->file);
-	free(script);
-	script = NULL;
+static void releaseScriptFile(ScriptFile* script) {
+	free(script->buffer);
+	script->buffer = NULL;
+	script->data = NULL;
 }
 
-static ScriptFile* openScriptFile(const wchar_t* sourcePath) {
-	ScriptFile* script = malloc(sizeof(ScriptFile));
+static bool readScriptFile(ScriptFile* script, const wchar_t* sourcePath, const wchar_t* name) {
 	memset(script, 0, sizeof(ScriptFile));
+	script->name = name;
 
-	if (!(script->file = _wfopen(sourcePath, L"rb"))) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to open the script file.");
-		closeScriptFile(script);
-		return NULL;
+	FILE* file = _wfopen(sourcePath, L"rb");
+	if (!file) {
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to open the script file.", name);
+		return false;
 	}
-	writeLog(LOG_VERBOSE, L"Script File Opened.");
-	return script;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	if (length == -1) {
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to get the length of the script!", name);
+		fclose(file);
+		return false;
+	}
+
+	script->fileLength = length;
+	script->buffer = malloc(length > 0 ? length : 1);
+	fseek(file, 0, SEEK_SET);
+	if (fread(script->buffer, 1, length, file) != (size_t)length) {
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to read the script file!", name);
+		fclose(file);
+		releaseScriptFile(script);
+		return false;
+	}
+	fclose(file);
+	script->data = script->buffer;
+	writeLog(LOG_VERBOSE, L"Script File Opened: %s", name);
+	return true;
 }
 
 static bool validateHeaderAndGetTextOffset(ScriptFile* script) {
@@ -94,48 +126,31 @@ static bool validateHeaderAndGetTextOffset(ScriptFile* script) {
 	 * need to deal with Byte 4 to 7 separately.
 	 */
 
-	if (fread(&(script->textOffset), 8, 1, script->file) != 1) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read the text offset from the script!");
-		return false;
-	}
+	if (script->fileLength < 8) return false;
+	memcpy(&(script->textOffset), script->data, 8);
 
+	/// Checked before the multiplication, which could wrap around.
+	if (script->textOffset >= script->fileLength) return false;
 	script->textOffset = (script->textOffset + 1) * 8;
+	if (script->textOffset > script->fileLength) return false;
 
-	fseek(script->file, 0, SEEK_END);
-	script->fileLength = ftell(script->file);
-	if (script->fileLength == -1) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to get the length of the script!");
-		return false;
-	}
-
-	if (script->textOffset > script->fileLength) {
-		writeLog(LOG_QUIET, L"ERROR: The source file is not a vaild script file!");
-		return false;
-	}
-	writeLog(LOG_VERBOSE, L"The source file's length is %u, and the text begins at %u",
-			script->fileLength, script->textOffset);
+	writeLog(LOG_VERBOSE, L"%s: the length is %u, and the text begins at %u",
+			script->name, script->fileLength, (u32)script->textOffset);
 	return true;
 }
 
-static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
-
-	if (!fsEnsureDirectoryExists(targetPath)) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to open or create the target directory!");
-		return false;
-	}
-
+/**
+ * The target directory must already exist. Only files inside it are
+ * created here, so several scripts can be extracted at once.
+ */
+static bool extractText(const ScriptFile* script, const wchar_t* targetPath,
+		u32* textCount, u32* totalCount) {
 	wchar_t* headPath = wcsAppend(targetPath, L"\\head.bin");
 	wchar_t* tailPath = wcsAppend(targetPath, L"\\tail.bin");
 	wchar_t* textPath = wcsAppend(targetPath, L"\\script.txt");
 
-	fseek(script->file, 0, SEEK_SET);
-	char* data = malloc(script->fileLength);
-	if (fread(data, 1, script->fileLength, script->file) != script->fileLength) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to read text data from the script file!");
-		free(headPath); free(tailPath); free(textPath);
-		free(data);
-		return false;
-	}
+	const char* data = script->data;
+	u32 length = script->fileLength;
 
 	/**
 	 * Put the head section into head.bin.
@@ -143,20 +158,18 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 	 * (There may be some nulls before the text segments.)
 	 */
 	u32 index = script->textOffset;
-	while (data[index] == '\0') ++index;
+	while (index < length && data[index] == '\0') ++index;
 
 	FILE* headFile;
 	if ((headFile = _wfopen(headPath, L"wb")) == NULL) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to create head.bin!");
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to create head.bin!", script->name);
 		free(headPath); free(tailPath); free(textPath);
-		free(data);
 		return false;
 	}
 
 	if (fwrite(data, sizeof(byte), index, headFile) != index) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write to head.bin!");
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to write to head.bin!", script->name);
 		free(headPath); free(tailPath); free(textPath);
-		free(data);
 		fclose(headFile);
 		return false;
 	}
@@ -171,9 +184,8 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 
 	FILE* textFile;
 	if ((textFile = _wfopen(textPath, L"wb")) == NULL) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to create script.txt!");
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to create script.txt!", script->name);
 		free(headPath); free(tailPath); free(textPath);
-		free(data);
 		return false;
 	}
 
@@ -189,9 +201,9 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 	 */
 
 	u32 extractedCount = 0;
-	u32 textCount = 0;
+	*textCount = 0;
 
-	while (true) {
+	while (index < length) {
 		/**
 		 * After the text section there is a ending section that consists of
 		 * 0x00, 0xFF and maybe some bytes with small value, detect them and
@@ -225,17 +237,29 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 		 * Mark them as 'NOT-TEXT'.
 		 */
 
+		/// A segment without its null would run past the end, so it belongs to the tail.
+		const char* segmentEnd = memchr(data + index, '\0', length - index);
+		if (segmentEnd == NULL) {
+			break;
+		}
+
 		bool notText = isdigit(data[index]) || isupper(data[index]);
 
-		wchar_t* text = toWCString(data + index, L"japanese");
+		/// Likewise a segment that is not valid Shift-JIS, so it is kept byte for byte.
+		wchar_t* text = toWCString(data + index, CODE_PAGE_SHIFT_JIS);
+		if (text == NULL) {
+			writeLog(LOG_VERBOSE, L"%s, Segment %u is not Shift-JIS, kept in tail.bin with the rest.",
+					script->name, extractedCount);
+			break;
+		}
 		u32 textLen = wcslen(text);
 
 		if (textLen > 4 && wcscmp(text + textLen - 4, L".bin") == 0) notText = true;
-		u32 rawLength = strlen(data + index);
+		u32 rawLength = segmentEnd - (data + index);
 		index += rawLength;
 
 		u32 followingNulls = 0;
-		while (data[index] == '\0') {
+		while (index < length && data[index] == '\0') {
 			++followingNulls;
 			++index;
 		}
@@ -251,7 +275,7 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 		fwprintf(textFile, L"\r\n%s\r\n\r\n", text);
 		free(text);
 		++extractedCount;
-		if (!notText) ++textCount;
+		if (!notText) ++(*textCount);
 	}
 
 	/// This position is in the header, just after "COUNT"
@@ -262,38 +286,272 @@ static bool extractText(ScriptFile* script, const wchar_t* targetPath) {
 	/// Now store the tail part.
 	FILE* tailFile;
 	if ((tailFile = _wfopen(tailPath, L"wb")) == NULL) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to open tail.bin!");
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to open tail.bin!", script->name);
 		free(headPath); free(tailPath); free(textPath);
-		free(data);
 		return false;
 	}
 
-	u32 tailLen = script->fileLength - index;
+	u32 tailLen = length - index;
 	if (fwrite(data + index, sizeof(byte), tailLen, tailFile) != tailLen) {
-		writeLog(LOG_QUIET, L"ERROR: Unable to write to tail.bin!");
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to write to tail.bin!", script->name);
 		free(headPath); free(tailPath); free(textPath);
-		free(data);
 		fclose(tailFile);
 		return false;
 	}
 	fclose(tailFile);
 
 	free(headPath); free(tailPath); free(textPath);
-	free(data);
 
-	writeLog(LOG_NORMAL, L"%u strings translatable, %u not, %u total.",
-			textCount, extractedCount - textCount, extractedCount);
+	*totalCount = extractedCount;
 	return true;
 }
 
 bool unpackScript(const wchar_t* sourcePath, const wchar_t* targetPath) {
 	writeLog(LOG_NORMAL, L"Unpacking Script: %s", sourcePath);
 	writeLog(LOG_NORMAL, L"To Directory: %s", targetPath);
-	ScriptFile* script = openScriptFile(sourcePath);
-	if (!script) return false;
-	bool result = validateHeaderAndGetTextOffset(script)
-				&& extractText(script, targetPath);
-	closeScriptFile(script);
+	ScriptFile script;
+	if (!readScriptFile(&script, sourcePath, sourcePath)) return false;
+
+	u32 textCount = 0;
+	u32 totalCount = 0;
+	bool result = validateHeaderAndGetTextOffset(&script);
+	if (!result) {
+		writeLog(LOG_QUIET, L"ERROR: The source file is not a vaild script file!");
+	} else if (!(result = fsEnsureDirectoryExists(targetPath))) {
+		writeLog(LOG_QUIET, L"ERROR: Unable to open or create the target directory!");
+	} else {
+		result = extractText(&script, targetPath, &textCount, &totalCount);
+	}
+	releaseScriptFile(&script);
+
+	if (result)
+		writeLog(LOG_NORMAL, L"%u strings translatable, %u not, %u total.",
+				textCount, totalCount - textCount, totalCount);
+	writeLog(LOG_NORMAL, (result) ? L"Unpacking Successful." : L"ERROR: Unpacking Failed.");
+	return result;
+}
+
+/**
+ * A script found by unpack-scripts: a file in the source directory, or an
+ * entry of the source package. Each one goes to its own directory, named
+ * after the script without the '.bin'.
+ */
+struct ScriptItem {
+	wchar_t* name;
+	u32 index;
+	u32 size;
+	bool superseded;
+	bool skipped;
+	wchar_t* targetPath;
+};
+typedef struct ScriptItem ScriptItem;
+
+/// Everything the workers of unpack-scripts share.
+struct ScriptJob {
+	const wchar_t* sourceDir;
+	PacReader* reader;
+	ScriptItem* items;
+	u32 count;
+	u32 capacity;
+	/// The decoders and buffers of each worker, with a package.
+	CodecContext** codecs;
+};
+typedef struct ScriptJob ScriptJob;
+
+static bool isScriptName(const wchar_t* name) {
+	u32 length = wcslen(name);
+	return length > 4 && _wcsicmp(name + length - 4, L".bin") == 0;
+}
+
+static void addItem(ScriptJob* job, const wchar_t* name, u32 index, u32 size) {
+	if (job->count == job->capacity) {
+		job->capacity = job->capacity ? job->capacity * 2 : 64;
+		job->items = realloc(job->items, sizeof(ScriptItem) * job->capacity);
+	}
+	ScriptItem* item = &(job->items[job->count++]);
+	memset(item, 0, sizeof(ScriptItem));
+	item->name = cloneWCString(name);
+	item->index = index;
+	item->size = size;
+}
+
+static int compareByName(const void* a, const void* b) {
+	const ScriptItem* x = a;
+	const ScriptItem* y = b;
+	/// Windows file names are case insensitive.
+	int result = _wcsicmp(x->name, y->name);
+	if (result != 0) return result;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compareBySizeDescending(const void* a, const void* b) {
+	const ScriptItem* x = a;
+	const ScriptItem* y = b;
+	if (x->superseded != y->superseded) return x->superseded - y->superseded;
+	if (x->size != y->size) return (x->size < y->size) - (x->size > y->size);
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+/// The caller has already moved into the source directory.
+static void findScriptFiles(ScriptJob* job) {
+	struct _wfinddata_t foundFile;
+	intptr_t handle = _wfindfirst(L"*", &foundFile);
+	int status = (handle == -1) ? -1 : 0;
+	u32 fileCount = 0;
+	while (status == 0) {
+		if ((foundFile.attrib & _A_SUBDIR) == 0 && isScriptName(foundFile.name))
+			addItem(job, foundFile.name, fileCount, foundFile.size);
+		++fileCount;
+		status = _wfindnext(handle, &foundFile);
+	}
+	if (handle != -1) _findclose(handle);
+}
+
+/**
+ * The names are converted here, prEntryName() is not for the workers.
+ * Returns false if any name cannot be converted, the others still go on.
+ */
+static bool findScriptEntries(ScriptJob* job) {
+	const IndexEntry* indexes = prEntries(job->reader);
+	u32 count = prEntryCount(job->reader);
+	bool result = true;
+	for (u32 i = 0; i < count; ++i) {
+		const wchar_t* name = prEntryName(job->reader, i);
+		if (name == NULL) {
+			writeLog(LOG_QUIET, L"ERROR: Entry %u, Unable to convert the name, skipped!", i);
+			result = false;
+		} else if (isScriptName(name)) {
+			addItem(job, name, i, indexes[i].decodedLen);
+		}
+	}
+	return result;
+}
+
+/**
+ * Like unpack, the last of several entries sharing one name wins, and the
+ * biggest scripts are started first. The superseded ones are sorted to
+ * the end and dropped.
+ */
+static void orderItems(ScriptJob* job, const wchar_t* targetDir) {
+	qsort(job->items, job->count, sizeof(ScriptItem), compareByName);
+	for (u32 i = 0; i + 1 < job->count; ++i) {
+		if (_wcsicmp(job->items[i].name, job->items[i + 1].name) == 0) {
+			writeLog(LOG_VERBOSE, L"Entry %u: %s, Superseded by Entry %u.",
+					job->items[i].index, job->items[i].name, job->items[i + 1].index);
+			job->items[i].superseded = true;
+		}
+	}
+	qsort(job->items, job->count, sizeof(ScriptItem), compareBySizeDescending);
+	while (job->count > 0 && job->items[job->count - 1].superseded) {
+		free(job->items[--(job->count)].name);
+	}
+
+	for (u32 i = 0; i < job->count; ++i) {
+		wchar_t* dirName = wcsSubstring(job->items[i].name, 0, wcslen(job->items[i].name) - 4);
+		job->items[i].targetPath = fsCombinePath(targetDir, dirName);
+		free(dirName);
+	}
+}
+
+static bool readScriptEntry(ScriptJob* job, u32 workerIndex, ScriptItem* item, ScriptFile* script) {
+	memset(script, 0, sizeof(ScriptFile));
+	script->name = item->name;
+	if (job->codecs[workerIndex] == NULL)
+		job->codecs[workerIndex] = newCodecContext();
+	script->data = (const char*)prReadEntryWith(job->reader, job->codecs[workerIndex], item->index);
+	script->fileLength = prEntries(job->reader)[item->index].decodedLen;
+	if (script->data == NULL) {
+		writeLog(LOG_QUIET, L"ERROR: Entry %u: %s, Unable to read the entry!", item->index, item->name);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Each script only touches its own directory, which is made right under
+ * the target directory. fsEnsureDirectoryExists() changes the current
+ * directory, so it is not for the workers.
+ */
+static bool unpackScriptItem(void* context, u32 workerIndex, u32 i) {
+	ScriptJob* job = context;
+	ScriptItem* item = &(job->items[i]);
+
+	ScriptFile script;
+	bool result;
+	if (job->reader) {
+		result = readScriptEntry(job, workerIndex, item, &script);
+	} else {
+		wchar_t* path = fsCombinePath(job->sourceDir, item->name);
+		result = readScriptFile(&script, path, item->name);
+		free(path);
+	}
+	if (!result) return false;
+
+	u32 textCount = 0;
+	u32 totalCount = 0;
+	if (!validateHeaderAndGetTextOffset(&script)) {
+		writeLog(LOG_NORMAL, L"Skipped: %s, Not a script file.", item->name);
+		item->skipped = true;
+	} else if (_wmkdir(item->targetPath) != 0 && errno != EEXIST) {
+		writeLog(LOG_QUIET, L"ERROR: %s, Unable to create the directory %s!", item->name, item->targetPath);
+		result = false;
+	} else {
+		result = extractText(&script, item->targetPath, &textCount, &totalCount);
+		if (result)
+			writeLog(LOG_NORMAL, L"Unpacked: %s, %u strings translatable, %u not.",
+					item->name, textCount, totalCount - textCount);
+	}
+	releaseScriptFile(&script);
+	return result;
+}
+
+bool unpackScripts(const wchar_t* sourcePath, const wchar_t* targetDir, bool useCache, u32 threadCount) {
+	writeLog(LOG_NORMAL, L"Unpacking Scripts: %s", sourcePath);
+	writeLog(LOG_NORMAL, L"To Directory: %s", targetDir);
+	if (!fsEnsureDirectoryExists(targetDir)) {
+		writeLog(LOG_QUIET, L"ERROR: Target directory does not exist and cannot be created.");
+		return false;
+	}
+
+	ScriptJob job;
+	memset(&job, 0, sizeof(ScriptJob));
+	bool result = true;
+	bool namesConverted = true;
+
+	/// The source is either a directory of scripts, or a package holding them.
+	if (_wchdir(sourcePath) == 0) {
+		job.sourceDir = sourcePath;
+		findScriptFiles(&job);
+	} else if ((job.reader = openPacReader(sourcePath, useCache)) != NULL) {
+		namesConverted = findScriptEntries(&job);
+	} else {
+		writeLog(LOG_QUIET, L"ERROR: The source is neither a directory nor a package!");
+		result = false;
+	}
+
+	if (result) {
+		orderItems(&job, targetDir);
+		writeLog(LOG_NORMAL, L"Found %u scripts.", job.count);
+		job.codecs = malloc(sizeof(CodecContext*) * threadCount);
+		memset(job.codecs, 0, sizeof(CodecContext*) * threadCount);
+		result = poolRunTasks(threadCount, NULL, job.count, unpackScriptItem, &job) && namesConverted;
+	}
+
+	u32 skippedCount = 0;
+	for (u32 i = 0; i < job.count; ++i) {
+		if (job.items[i].skipped) ++skippedCount;
+		free(job.items[i].name);
+		free(job.items[i].targetPath);
+	}
+	if (job.codecs) {
+		for (u32 i = 0; i < threadCount; ++i) deleteCodecContext(job.codecs[i]);
+		free(job.codecs);
+	}
+	free(job.items);
+	closePacReader(job.reader);
+
+	if (result)
+		writeLog(LOG_NORMAL, L"%u scripts unpacked, %u skipped.", job.count - skippedCount, skippedCount);
 	writeLog(LOG_NORMAL, (result) ? L"Unpacking Successful." : L"ERROR: Unpacking Failed.");
 	return result;
 }
@@ -9,7 +9,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
-#include <locale.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 
 #include "StringUtils.h"
 
@@ -27,24 +28,132 @@ wchar_t* cloneWCString(const wchar_t* src) {
 	 return result;
 }
 
-wchar_t* toWCString(const char* mbs, const wchar_t* locale) {
+struct CodePageName {
+	const wchar_t* name;
+	u32 codePage;
+};
+
+/// The language names the C runtime of MSVC knows, for the encodings a NeXaS game may want.
+static const struct CodePageName CODE_PAGE_NAMES[] = {
+	{ L"japanese", CODE_PAGE_SHIFT_JIS }, { L"jpn", CODE_PAGE_SHIFT_JIS },
+	{ L"chinese", CODE_PAGE_GBK }, { L"chs", CODE_PAGE_GBK },
+	{ L"chinese-simplified", CODE_PAGE_GBK }, { L"chinese-traditional", 950 },
+	{ L"cht", 950 }, { L"korean", 949 }, { L"kor", 949 },
+	{ L"english", 1252 }, { L"american", 1252 }, { L"enu", 1252 },
+	{ L"gb18030", CODE_PAGE_GB18030 },
+	{ L"utf-8", CODE_PAGE_UTF8 }, { L"utf8", CODE_PAGE_UTF8 },
+};
+
+/**
+ * The code pages toMBString() and toWCString() can work with. Windows
+ * refuses their flags for ISO-2022 and the like, and would fail every text.
+ */
+static bool isSupportedCodePage(unsigned long codePage) {
+	return codePage == 874 || codePage == 932 || codePage == 936 || codePage == 949 || codePage == 950
+			|| (codePage >= 1250 && codePage <= 1258)
+			|| codePage == CODE_PAGE_GB18030 || codePage == CODE_PAGE_UTF8;
+}
+
+/// These encode every character, and Windows takes no best-fit flag nor default report for them.
+static bool hasEveryCharacter(u32 codePage) {
+	return codePage == CODE_PAGE_UTF8 || codePage == CODE_PAGE_GB18030;
+}
+
+bool codePageOf(const wchar_t* name, u32* codePage) {
+	if (name == NULL) return false;
+
+	/// "Language_Country.CodePage", or just ".CodePage".
+	const wchar_t* dot = wcsrchr(name, L'.');
+	if (dot != NULL) {
+		if (_wcsicmp(dot + 1, L"ACP") == 0) {
+			*codePage = CODE_PAGE_ANSI;
+			return true;
+		}
+		if (_wcsicmp(dot + 1, L"UTF8") == 0 || _wcsicmp(dot + 1, L"UTF-8") == 0) {
+			*codePage = CODE_PAGE_UTF8;
+			return true;
+		}
+		wchar_t* end = NULL;
+		unsigned long number = wcstoul(dot + 1, &end, 10);
+		if (end == dot + 1 || *end != L'\0' || !isSupportedCodePage(number)) return false;
+		*codePage = (u32)number;
+		return true;
+	}
+
+	/// The language alone, as in "japanese" or "Japanese_Japan".
+	const wchar_t* underscore = wcschr(name, L'_');
+	size_t length = underscore ? (size_t)(underscore - name) : wcslen(name);
+	for (size_t i = 0; i < sizeof(CODE_PAGE_NAMES) / sizeof(CODE_PAGE_NAMES[0]); ++i) {
+		if (wcslen(CODE_PAGE_NAMES[i].name) == length
+				&& _wcsnicmp(CODE_PAGE_NAMES[i].name, name, length) == 0) {
+			*codePage = CODE_PAGE_NAMES[i].codePage;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Names and script texts are mostly short, so each conversion is done in
+ * one pass into a buffer big enough for the worst case: no encoding takes
+ * more than one UTF-16 unit per byte, nor more than 4 bytes per unit.
+ * Pure ASCII is copied over without asking Windows at all.
+ */
+wchar_t* toWCString(const char* mbs, u32 codePage) {
 	if (mbs == NULL) return NULL;
-	_wsetlocale(LC_ALL, locale);
-	u32 len = mbstowcs(NULL, mbs, CBUF_TRY_SIZE);
-	wchar_t* result = malloc(sizeof(wchar_t) * (len + 1));
-	mbstowcs(result, mbs, len + 1);
+
+	size_t len = 0;
+	while ((byte)mbs[len] >= 0x01 && (byte)mbs[len] < 0x80) ++len;
+	if (mbs[len] == '\0') {
+		wchar_t* result = newWCString(len);
+		for (size_t i = 0; i <= len; ++i) result[i] = (wchar_t)mbs[i];
+		return result;
+	}
+
+	len += strlen(mbs + len);
+	wchar_t* result = newWCString(len);
+	/// Bytes that are not valid in the code page fail, rather than turn into U+30FB.
+	if (MultiByteToWideChar(codePage, MB_ERR_INVALID_CHARS, mbs, len + 1, result, len + 1) <= 0) {
+		free(result);
+		return NULL;
+	}
 	return result;
 }
 
-char* toMBString(const wchar_t* wcs, const wchar_t* locale) {
+char* toMBString(const wchar_t* wcs, u32 codePage) {
 	if (wcs == NULL) return NULL;
-	_wsetlocale(LC_ALL, locale);
-	u32 len = wcstombs(NULL, wcs, CBUF_TRY_SIZE);
-	char* result = malloc(sizeof(char) * (len + 1));
-	wcstombs(result, wcs, len + 1);
+
+	size_t len = 0;
+	while (wcs[len] != L'\0' && wcs[len] < 0x80) ++len;
+	if (wcs[len] == L'\0') {
+		char* result = newMBString(len);
+		for (size_t i = 0; i <= len; ++i) result[i] = (char)wcs[i];
+		return result;
+	}
+
+	len += wcslen(wcs + len);
+	char* result = newMBString(len * 4);
+	/**
+	 * Without WC_NO_BEST_FIT_CHARS, Windows quietly puts in a look-alike
+	 * (e.g. 'e' for 'é') and does not report it as a default character.
+	 * UTF-8 and GB18030 take neither the flag nor the report, and have
+	 * every character.
+	 */
+	bool complete = hasEveryCharacter(codePage);
+	BOOL usedDefault = FALSE;
+	int written = WideCharToMultiByte(codePage, complete ? 0 : WC_NO_BEST_FIT_CHARS, wcs, len + 1,
+			result, len * 4 + 1, NULL, complete ? NULL : &usedDefault);
+	if (written <= 0 || usedDefault) {
+		free(result);
+		return NULL;
+	}
 	return result;
 }
 
+char* toUTF8String(const wchar_t* wcs) {
+	return toMBString(wcs, CODE_PAGE_UTF8);
+}
+
 wchar_t* wcsAppend(const wchar_t* first, const wchar_t* second) {
 	if (first == NULL) return cloneWCString(second);
 	if (second == NULL) return cloneWCString(first);
@@ -11,10 +11,35 @@
 
 #include "CommonDef.h"
 
+/**
+ * Code pages, numbered as Windows does. The conversions are done by Windows
+ * with its own tables, without touching the C locale, so they can be used
+ * from any thread.
+ */
+#define CODE_PAGE_ANSI		0
+#define CODE_PAGE_SHIFT_JIS	932
+#define CODE_PAGE_GBK		936
+#define CODE_PAGE_GB18030	54936
+#define CODE_PAGE_UTF8		65001
+
 wchar_t* newWCString(u32 size);
 wchar_t* cloneWCString(const wchar_t* src);
-wchar_t* toWCString(const char* mbs, const wchar_t* locale);
-char* toMBString(const wchar_t* wcs, const wchar_t* locale);
+
+/**
+ * Maps an encoding name to its code page: a language name as setlocale()
+ * takes it ("japanese", "chinese", "korean"...), "utf-8", or a name ending
+ * in ".<number>" like "Japanese_Japan.932". Returns false for other names,
+ * and for code pages the conversions below do not handle (ISO-2022, EBCDIC,
+ * UTF-7...). Those handled are 874, 932, 936, 949, 950, 1250 to 1258,
+ * GB18030 and UTF-8, and the ANSI code page with ".ACP".
+ */
+bool codePageOf(const wchar_t* name, u32* codePage);
+
+/// Returns NULL if mbs is not valid in the code page.
+wchar_t* toWCString(const char* mbs, u32 codePage);
+/// Returns NULL if some character cannot be represented in the code page.
+char* toMBString(const wchar_t* wcs, u32 codePage);
+char* toUTF8String(const wchar_t* wcs);
 
 wchar_t* wcsAppend(const wchar_t* first, const wchar_t* second);
 wchar_t* wcsSubstring(const wchar_t* src, u32 startIndex, u32 endIndex);
@@ -0,0 +1,91 @@
+/**
+ * @file		ThreadPool.c
+ * @brief		A tiny worker pool that runs a list of indexed tasks.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#include <stdlib.h>
+
+#include "ThreadPool.h"
+
+struct Pool {
+	const u32* order;
+	u32 taskCount;
+	PoolTask task;
+	void* context;
+	volatile LONG nextTask;
+	volatile LONG failed;
+};
+typedef struct Pool Pool;
+
+struct Worker {
+	Pool* pool;
+	u32 index;
+};
+typedef struct Worker Worker;
+
+/**
+ * Workers grab the next task in the given order until the list runs
+ * out or some task fails. So when the order is "largest first", the
+ * big ones are started early and the small ones fill the gaps at the end.
+ */
+static void runWorker(Pool* pool, u32 workerIndex) {
+	while (!pool->failed) {
+		u32 next = (u32)InterlockedIncrement(&(pool->nextTask)) - 1;
+		if (next >= pool->taskCount) break;
+		u32 taskIndex = pool->order ? pool->order[next] : next;
+		if (!pool->task(pool->context, workerIndex, taskIndex)) {
+			InterlockedExchange(&(pool->failed), 1);
+		}
+	}
+}
+
+static unsigned __stdcall workerEntry(void* param) {
+	Worker* worker = param;
+	runWorker(worker->pool, worker->index);
+	return 0;
+}
+
+u32 poolDefaultThreadCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+bool poolRunTasks(u32 threadCount, const u32* order, u32 taskCount, PoolTask task, void* context) {
+	Pool pool = { order, taskCount, task, context, 0, 0 };
+
+	if (threadCount > taskCount) threadCount = taskCount;
+	if (threadCount <= 1) {
+		/// No need to bother the OS, the caller is our only worker.
+		runWorker(&pool, 0);
+		return !pool.failed;
+	}
+
+	Worker* workers = malloc(sizeof(Worker) * threadCount);
+	HANDLE* threads = malloc(sizeof(HANDLE) * threadCount);
+
+	/// The calling thread is Worker 0, so we only spawn the others.
+	u32 spawned = 1;
+	for (; spawned < threadCount; ++spawned) {
+		workers[spawned].pool = &pool;
+		workers[spawned].index = spawned;
+		threads[spawned] = (HANDLE)_beginthreadex(NULL, 0, workerEntry, &workers[spawned], 0, NULL);
+		if (threads[spawned] == 0) break;
+	}
+
+	runWorker(&pool, 0);
+
+	for (u32 i = 1; i < spawned; ++i) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+	free(threads);
+	free(workers);
+	return !pool.failed;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file		ThreadPool.h
+ * @brief		A tiny worker pool that runs a list of indexed tasks.
+ * @copyright	Covered by 2-clause BSD, please refer to license.txt.
+ * @author		zbspac contributors
+ * @date		2026.10
+ */
+
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include "CommonDef.h"
+
+/**
+ * A task receives the shared context, the index of the worker running it
+ * (0 to threadCount - 1, handy for per-worker resources) and the index of
+ * the task itself. Returning false stops the pool from starting new tasks.
+ */
+typedef bool (*PoolTask)(void* context, u32 workerIndex, u32 taskIndex);
+
+u32 poolDefaultThreadCount(void);
+bool poolRunTasks(u32 threadCount, const u32* order, u32 taskCount, PoolTask task, void* context);
+
+#endif
@@ -7,7 +7,8 @@
  * @date		2010.02
  * @warning		This utility is specially designed for the resource file format
  *				used in Baldr Sky, namely PAC format for GIGA's NeXaS engine,
- *				Variant 4, and may be incompatible with other GIGA games.
+ *				Variant 4. Variants 1 (Baldr Force EXE) and 2 are supported as well,
+ *				but it may still be incompatible with other GIGA games.
  */
 
 #include <stdlib.h>
@@ -18,32 +19,72 @@
 #include "NexasPackage.h"
 #include "ScriptFile.h"
 
-const wchar_t* USAGE_STRING = L"Usage: zbspac [quietly|verbosely] <operation> source_path [target_path]";
+const wchar_t* USAGE_STRING = L"Usage: zbspac [quietly|verbosely] [-j threads] [-c] [-z|-zh] [-l level] <operation> source_path [target_path]";
 
 void init() {
 	setLogLevel(LOG_NORMAL);
 }
 
 bool processPackCmd(CmdArgs* args) {
-	return packPackage(argSourcePath(args), argTargetPath(args), false);
+	return packPackage(argSourcePath(args), argTargetPath(args), false,
+			argCompress(args), argHuffman(args), argThreadCount(args));
 }
 
 bool processPackBfeCmd(CmdArgs* args) {
-	return packPackage(argSourcePath(args), argTargetPath(args), true);
+	return packPackage(argSourcePath(args), argTargetPath(args), true,
+			argCompress(args), false, argThreadCount(args));
 }
 
 bool processUnpackCmd(CmdArgs* args) {
-	return unpackPackage(argSourcePath(args), argTargetPath(args));
+	return unpackPackage(argSourcePath(args), argTargetPath(args), argThreadCount(args));
+}
+
+bool processExtractCmd(CmdArgs* args) {
+	return extractEntries(argSourcePath(args), argEntryNames(args), argEntryNameCount(args),
+			argTargetPath(args), argThreadCount(args));
+}
+
+bool processCatCmd(CmdArgs* args) {
+	return catEntry(argSourcePath(args), argEntryNames(args)[0]);
+}
+
+bool processListCmd(CmdArgs* args) {
+	return listPackage(argSourcePath(args));
+}
+
+bool processPatchCmd(CmdArgs* args) {
+	return patchPackage(argSourcePath(args), argTargetPath(args));
+}
+
+bool processCompactCmd(CmdArgs* args) {
+	return compactPackage(argSourcePath(args));
+}
+
+bool processMergeCmd(CmdArgs* args) {
+	return mergePackage(argSourcePath(args), argTargetPath(args), argOutputPath(args));
+}
+
+bool processBuildTranslationCmd(CmdArgs* args) {
+	return buildTranslation(argSourcePath(args), argTargetPath(args), argOutputPath(args));
 }
 
 bool processPackScriptCmd(CmdArgs* args) {
 	return packScript(argSourcePath(args), argTargetPath(args));
 }
 
+bool processPackScriptsCmd(CmdArgs* args) {
+	return packScripts(argSourcePath(args), argTargetPath(args), argThreadCount(args));
+}
+
 bool processUnpackScriptCmd(CmdArgs* args) {
 	return unpackScript(argSourcePath(args), argTargetPath(args));
 }
 
+bool processUnpackScriptsCmd(CmdArgs* args) {
+	return unpackScripts(argSourcePath(args), argTargetPath(args),
+			argUseIndexCache(args), argThreadCount(args));
+}
+
 bool processAboutCmd(CmdArgs* args) {
 	writeOnlyOnLevel(LOG_QUIET, L"Shhhhhhh...... I should stay quiet......");
 	writeLog(LOG_NORMAL, L"zbspac: a resource (un)packer for Baldr Sky / Baldr Force EXE.");
@@ -54,11 +95,32 @@ bool processAboutCmd(CmdArgs* args) {
 
 bool processHelpCmd(CmdArgs* args) {
 	writeOnlyOnLevel(LOG_QUIET, L"Shhhhhhh...... I should stay quiet......");
-	writeLog(LOG_NORMAL, L"Usage: zbspac [quietly|verbosely] <operation> source_path [target_path]");
+	writeLog(LOG_NORMAL, L"Usage: zbspac [quietly|verbosely] [-j threads] [-c] [-z|-zh] [-l level] <operation> source_path [target_path]");
 	writeLog(LOG_NORMAL, L"");
 	writeLog(LOG_NORMAL, L"Available operations are:");
 	writeLog(LOG_NORMAL, L"  pack, pack-bfe, unpack, pack-script, unpack-script, help, about");
 	writeLog(LOG_NORMAL, L"");
+	writeLog(LOG_NORMAL, L"To get single entries out of a package:");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] extract package_path entry_name...");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] cat package_path entry_name");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] list package_path");
+	writeLog(LOG_NORMAL, L"");
+	writeLog(LOG_NORMAL, L"To unpack all scripts in a directory or a package at once:");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] [-j threads] unpack-scripts source_path [target_dir]");
+	writeLog(LOG_NORMAL, L"And to pack the changed ones back:");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] [-j threads] pack-scripts scripts_dir [target_dir]");
+	writeLog(LOG_NORMAL, L"");
+	writeLog(LOG_NORMAL, L"To update a package in place:");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] patch package_path overlay_dir");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] compact package_path");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] merge package_path overlay_dir output_path");
+	writeLog(LOG_NORMAL, L"  zbspac [quietly|verbosely] build-translation scripts_dir package_path output_path");
+	writeLog(LOG_NORMAL, L"");
+	writeLog(LOG_NORMAL, L"Options: -j threads, -c (keep the decoded index in package.pacidx),");
+	writeLog(LOG_NORMAL, L"         -z (compress the entries when packing),");
+	writeLog(LOG_NORMAL, L"         -zh (huffman-encode them instead, PAC Variant 2),");
+	writeLog(LOG_NORMAL, L"         -l level (0 to 3, how hard LZSS looks for matches)");
+	writeLog(LOG_NORMAL, L"");
 	writeLog(LOG_NORMAL, L"Please refer to instructions.txt for detail.");
 
 	return true;
@@ -75,6 +137,8 @@ int main(int argc, char** argv) {
 	}
 
 	setLogLevel(argLogLevel(args));
+	useIndexCache(argUseIndexCache(args));
+	useLzssLevel(argLzssLevel(args));
 	bool result;
 
 	switch (argCmdType(args)) {
@@ -87,12 +151,39 @@ int main(int argc, char** argv) {
 	case CMD_UNPACK:
 		result = processUnpackCmd(args);
 		break;
+	case CMD_EXTRACT:
+		result = processExtractCmd(args);
+		break;
+	case CMD_CAT:
+		result = processCatCmd(args);
+		break;
+	case CMD_LIST:
+		result = processListCmd(args);
+		break;
+	case CMD_PATCH:
+		result = processPatchCmd(args);
+		break;
+	case CMD_COMPACT:
+		result = processCompactCmd(args);
+		break;
+	case CMD_MERGE:
+		result = processMergeCmd(args);
+		break;
+	case CMD_BUILD_TRANSLATION:
+		result = processBuildTranslationCmd(args);
+		break;
 	case CMD_PACK_SCRIPT:
 		result = processPackScriptCmd(args);
 	break;
+	case CMD_PACK_SCRIPTS:
+		result = processPackScriptsCmd(args);
+		break;
 	case CMD_UNPACK_SCRIPT:
 		result = processUnpackScriptCmd(args);
 		break;
+	case CMD_UNPACK_SCRIPTS:
+		result = processUnpackScriptsCmd(args);
+		break;
 	case CMD_ABOUT:
 		result = processAboutCmd(args);
 		break;